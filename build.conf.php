@@ -39,4 +39,13 @@ $extras = [
     "-ljsoncpp",
     "-lnlopt",
     "-lSDL2 -lSDL2_ttf"
-];
\ No newline at end of file
+];
+
+// precompiled headers (src/lib/utils.h and tests/Test.h are always precompiled)
+$pchs = [
+    // "src/lib/Clock.h",
+];
+
+// compile cache, survives the cleanup (-c) of the build folder
+$cache_dir = getenv("HOME") . "/.cache/cbuild";
+$cache_size = 1024; // MB, the least recently used objects get evicted above it
@@ -61,9 +61,311 @@ function replace_extension($filename, $new_extension)
     return $info['dirname'] . '/' . $info['filename'] . '.' . $new_extension;
 }
 
-function build(
+function cpu_count()
+{
+    $count = (int)trim((string)@shell_exec("nproc 2>/dev/null"));
+    return $count > 0 ? $count : 1;
+}
+
+// Build profiler state (see --profile-build), null when profiling is off
+function &build_profile()
+{
+    static $profile = null;
+    return $profile;
+}
+
+// Wraps the command to write the peak resident memory (KB) of its whole process tree into $memfile
+// when it finishes (GNU time reads it from wait4(), even for jobs too short to be sampled),
+// the command is kept as it is without GNU time
+function proc_mem_wrap($cmd, &$memfile)
+{
+    $memfile = null;
+    if (!is_executable("/usr/bin/time")) {
+        return $cmd;
+    }
+    $memfile = tempnam(sys_get_temp_dir(), "build-mem-");
+    return "/usr/bin/time -f %M -o " . escapeshellarg($memfile) . " sh -c " . escapeshellarg($cmd);
+}
+
+// The peak memory (KB) written by the proc_mem_wrap() command, the file is removed
+function proc_mem_read($memfile)
+{
+    $lines = file($memfile, FILE_IGNORE_NEW_LINES | FILE_SKIP_EMPTY_LINES) ?: [];
+    @unlink($memfile);
+    return (int)end($lines); // after "Command exited with non-zero status" on failures
+}
+
+// Peak resident memory (KB) of a process and its descendants (e.g. g++ -> cc1plus), sampled from /proc
+// (the fallback without GNU time, it misses the jobs finishing between the samples)
+function proc_peak_kb($pid)
+{
+    $peak = 0;
+    $status = @file_get_contents("/proc/$pid/status");
+    if ($status && preg_match('/^VmHWM:\s+(\d+)/m', $status, $matches)) {
+        $peak = (int)$matches[1];
+    }
+    $children = trim((string)@file_get_contents("/proc/$pid/task/$pid/children"));
+    foreach ($children ? explode(" ", $children) : [] as $child) {
+        $peak = max($peak, proc_peak_kb((int)$child));
+    }
+    return $peak;
+}
+
+// Records a finished command into the build profile,
+// the -ftime-report of the compiler is cut from the output and saved next to the target
+function profile_record($target, $cmd, $time, $mem, &$output)
+{
+    $profile = &build_profile();
+    $kind = strpos($cmd, " -E ") !== false ? "preprocess" : (
+        strpos($cmd, " -x c++-header ") !== false ? "pch" : (
+        strpos($cmd, " -c ") !== false ? "compile" : "link"));
+    $record = ['target' => $target, 'kind' => $kind, 'time' => round($time, 3), 'mem_kb' => $mem];
+    if (preg_match('/^Time variable.*?^ TOTAL[^\n]*\n/ms', $output, $matches)) {
+        $output = str_replace($matches[0], "", $output);
+        file_put_contents("$target.time-report", $matches[0]);
+        $record['time_report'] = "$target.time-report";
+        foreach (['parsing', 'lang. deferred', 'opt and generate'] as $phase) {
+            if (preg_match('/^ phase ' . preg_quote($phase, '/') . '\s*:.*?([\d.]+) \(\s*\d+%\)\s+\S+\s+\(\s*\d+%\)\s*$/m', $matches[0], $pmatches)) {
+                $record['phases'][$phase] = (float)$pmatches[1];
+            }
+        }
+    }
+    $profile['records'][] = $record;
+}
+
+// Prints the slowest compile/link commands and the headers costing the most in aggregate
+// (the compile time, or the parse time with -ftime-report, of every TU including them),
+// and saves the whole profile as JSON
+function profile_report($top = 15)
+{
+    $profile = &build_profile();
+    $records = $profile['records'] ?? [];
+    usort($records, function ($a, $b) { return $b['time'] <=> $a['time']; });
+
+    $headers = [];
+    foreach ($records as $record) {
+        if ($record['kind'] !== "compile") {
+            continue;
+        }
+        $cost = $record['phases']['parsing'] ?? $record['time'];
+        foreach (read_deps(replace_extension($record['target'], "d")) ?? [] as $dep) {
+            if (preg_match('/\.(h|hpp)$/', $dep)) {
+                $headers[$dep]['time'] = ($headers[$dep]['time'] ?? 0) + $cost;
+                $headers[$dep]['tus'] = ($headers[$dep]['tus'] ?? 0) + 1;
+            }
+        }
+    }
+    uasort($headers, function ($a, $b) { return $b['time'] <=> $a['time']; });
+
+    $table = sprintf("  %-10s %9s %10s  %s\n", "kind", "time (s)", "mem (MB)", "target");
+    foreach (array_slice($records, 0, $top) as $record) {
+        $table .= sprintf("  %-10s %9.2f %10.1f  %s\n", $record['kind'], $record['time'], $record['mem_kb'] / 1024, $record['target']);
+    }
+    hlight("Slowest build steps:\n$table");
+
+    $table = sprintf("  %9s %5s  %s\n", "time (s)", "TUs", "header");
+    foreach (array_slice($headers, 0, $top, true) as $header => $cost) {
+        $table .= sprintf("  %9.2f %5d  %s\n", $cost['time'], $cost['tus'], $header);
+    }
+    hlight("Headers by aggregate cost of the TUs including them:\n$table");
+
+    $file = $profile['file'];
+    $headers_list = [];
+    foreach ($headers as $header => $cost) {
+        $headers_list[] = ['header' => $header, 'time' => round($cost['time'], 3), 'tus' => $cost['tus']];
+    }
+    file_put_contents($file, json_encode(['records' => $records, 'headers' => $headers_list], JSON_PRETTY_PRINT | JSON_UNESCAPED_SLASHES));
+    hlight("Build profile saved: $file");
+}
+
+// Runs the commands concurrently, at most $jobs at a time.
+// Each job output is buffered and printed at once when the job finishes so
+// the outputs of the parallel jobs never interleave.
+// After the first failure no more job is started, the running ones are
+// waited for, then it throws (or returns the failed exit code).
+// The run time of each job (seconds) is collected into $times by the command keys.
+function run_parallel($cmds, $jobs = 1, $throws = true, &$times = null)
+{
+    $profile = &build_profile();
+    $queue = $cmds;
+    if ($profile && $profile['trace']) {
+        foreach ($cmds as $key => $cmd) {
+            if (strpos($cmd, " -c ") !== false || strpos($cmd, " -x c++-header ") !== false) {
+                $queue[$key] = "$cmd -ftime-report";
+            }
+        }
+    }
+    $running = [];
+    $times = [];
+    $failed = 0;
+    while (($queue && !$failed) || $running) {
+        while ($queue && !$failed && count($running) < $jobs) {
+            $key = array_key_first($queue);
+            $cmd = $queue[$key];
+            unset($queue[$key]);
+            $memfile = null;
+            $process = proc_open($profile ? proc_mem_wrap($cmd, $memfile) : $cmd, [
+                ["pipe", "r"],  // stdin
+                ["pipe", "w"],  // stdout
+                ["pipe", "w"]   // stderr
+            ], $pipes);
+            if (!is_resource($process)) {
+                if ($memfile) @unlink($memfile);
+                echo "$ $cmd\n";
+                $failed = -1;
+                break;
+            }
+            fclose($pipes[0]);
+            stream_set_blocking($pipes[1], false);
+            stream_set_blocking($pipes[2], false);
+            $running[$key] = [
+                'cmd' => $cmd, 'process' => $process, 'pipes' => $pipes, 'output' => "", 'start' => microtime(true), 'mem' => 0,
+                'memfile' => $memfile
+            ];
+        }
+
+        if ($profile) {
+            foreach ($running as $key => $job) {
+                if ($job['memfile']) continue;
+                $running[$key]['mem'] = max($job['mem'], proc_peak_kb(proc_get_status($job['process'])['pid']));
+            }
+        }
+
+        $reads = [];
+        foreach ($running as $job) {
+            if (!feof($job['pipes'][1])) $reads[] = $job['pipes'][1];
+            if (!feof($job['pipes'][2])) $reads[] = $job['pipes'][2];
+        }
+        if ($reads) {
+            $writes = $excepts = null;
+            stream_select($reads, $writes, $excepts, 0, 100000);
+        }
+
+        foreach ($running as $key => $job) {
+            $running[$key]['output'] .= stream_get_contents($job['pipes'][1]) . stream_get_contents($job['pipes'][2]);
+            if (!feof($job['pipes'][1]) || !feof($job['pipes'][2])) {
+                continue;
+            }
+            fclose($job['pipes'][1]);
+            fclose($job['pipes'][2]);
+            $return = proc_close($job['process']);
+            $times[$key] = microtime(true) - $job['start'];
+            if ($profile) {
+                if ($job['memfile']) $running[$key]['mem'] = proc_mem_read($job['memfile']);
+                profile_record($key, $job['cmd'], $times[$key], $running[$key]['mem'], $running[$key]['output']);
+            }
+            echo "$ {$job['cmd']}\n" . $running[$key]['output'];
+            if ($return) {
+                echo "return: $return\n";
+                if (!$failed) $failed = $return;
+            }
+            unset($running[$key]);
+        }
+    }
+    if ($throws && $failed) {
+        throw new Exception("Command failed: $failed", $failed);
+    }
+    return $failed;
+}
+
+// Reads the prerequisites of the target from a compiler generated (-MMD) dependency file,
+// returns null when there is no dependency file (e.g. never compiled)
+function read_deps($dfile)
+{
+    if (!file_exists($dfile)) {
+        return null;
+    }
+    $content = str_replace("\\\n", " ", file_get_contents($dfile));
+    // the first rule is the object, the rest are the phony header targets of -MP
+    $rule = explode("\n", $content)[0];
+    $colon = strpos($rule, ": ");
+    if ($colon === false) {
+        return null;
+    }
+    return preg_split('/\s+/', trim(substr($rule, $colon + 2)), -1, PREG_SPLIT_NO_EMPTY);
+}
+
+// A target is up to date when it was made by the same command
+// and none of its dependencies is newer (same as make does)
+function is_up_to_date($target, $deps, $cmd)
+{
+    if ($deps === null || !file_exists($target)) {
+        return false;
+    }
+    if (!file_exists("$target.cmd") || file_get_contents("$target.cmd") !== $cmd) {
+        return false;
+    }
+    $ttime = filemtime($target);
+    foreach ($deps as $dep) {
+        if (!file_exists($dep) || filemtime($dep) > $ttime) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Collects the local (quoted) includes of a source file recursively
+function local_includes($file, &$found = [])
+{
+    preg_match_all('/^\s*#\s*include\s*"([^"]+)"/m', file_get_contents($file), $matches);
+    foreach ($matches[1] as $include) {
+        $path = realpath($include[0] === "/" ? $include : dirname($file) . "/$include");
+        if ($path && !isset($found[$path])) {
+            $found[$path] = true;
+            local_includes($path, $found);
+        }
+    }
+    return $found;
+}
+
+// Picks the precompiled header for a source file: the configured header which
+// covers the most of its local includes, null when it includes none of them
+function pch_for($file, $pchs)
+{
+    $includes = local_includes($file);
+    $best = null;
+    $best_size = -1;
+    foreach ($pchs as $pch) {
+        $path = realpath($pch);
+        if (!$path || !isset($includes[$path])) {
+            continue;
+        }
+        $size = count(local_includes($path));
+        if ($size > $best_size) {
+            $best = $pch;
+            $best_size = $size;
+        }
+    }
+    return $best;
+}
+
+// Makes the rule of a precompiled header, one for each flag set (debug/release/coverage..)
+// g++ refuses "#pragma once" in the main file so a wrapper including the header gets precompiled
+function pch_rule($header, $copts, $extras, $outdir)
+{
+    $dir = "$outdir/pch/" . substr(md5($copts), 0, 8);
+    if (!is_dir($dir)) {
+        run("mkdir -p $dir");
+    }
+    $wrapper = "$dir/" . str_replace("/", "_", $header);
+    $content = "#include \"" . realpath($header) . "\"\n";
+    if (!file_exists($wrapper) || file_get_contents($wrapper) !== $content) {
+        file_put_contents($wrapper, $content);
+    }
+    return [
+        'header' => $header,
+        'wrapper' => $wrapper,
+        'gch' => "$wrapper.gch",
+        'cmd' => "g++ $copts -MMD -MP -x c++-header $wrapper -o $wrapper.gch $extras",
+        'dfile' => "$wrapper.d",
+    ];
+}
+
+// Collects the commands to build a folder without running them,
+// so the compile jobs of more folders can be scheduled together.
+function build_plan(
     $folder, $copts = "-std=c++17 -Wall -Wextra -Werror -Wpedantic -O3", $outext = "o", 
-    $maincpp = "main.cpp", $mainexe = "main", $extras = "", $ofiles = [], $outdir = "build"
+    $maincpp = "main.cpp", $mainexe = "main", $extras = "", $ofiles = [], $outdir = "build", $pchs = [], $unity = 0
 ) {
     if (!$folder) {
         throw new Exception("No input folder", -1);
@@ -87,8 +389,25 @@ function build(
         }
     }
 
-    hlight("Collecting and compile source files...");
+    $pch_rules = [];
+    $with_pch = function ($file, $rule) use ($pchs, $copts, $extras, $outdir, &$pch_rules) {
+        $header = pch_for($file, $pchs);
+        if (!$header) {
+            return $rule;
+        }
+        $pch = pch_rule($header, $copts, $extras, $outdir);
+        $pch_rules[$pch['gch']] = $pch;
+        $rule['cmd'] = str_replace(" -c ", " -include {$pch['wrapper']} -c ", $rule['cmd']);
+        $rule['deps'] = [$pch['gch']];
+        $rule['pch'] = $pch;
+        return $rule;
+    };
+
+    hlight("Collecting source files...");
     $ipaths = [];
+    $compiles = [];
+    $own_ofiles = [];
+    $cfiles = [];
     foreach ($hfiles as $hfile) {
         //echo "$hfile\n";
         $cfile = replace_extension($hfile, "cpp");
@@ -97,40 +416,404 @@ function build(
             $ipaths[] = dirname(realpath($hfile));
             continue;
         }
-        $ofile = "$outdir/" . replace_extension($hfile, $outext);
-        $ofiles[] = $ofile;
+        $cfiles[] = $cfile;
+    }
+    $ipaths = array_unique($ipaths);
 
-        // only make when modified
-        if (file_exists($ofile)) {
-            $otime = filemtime($ofile);
-            if ($otime > filemtime($cfile) || $otime > filemtime($hfile)) {
-                continue;
+    if ($unity && $cfiles) {
+        // unity (jumbo) build: the sources are compiled in $unity combined translation units
+        // with the include paths of the header-only files, same as the main file
+        hlight("Collecting unity source files...");
+        if (!is_dir("$outdir/unity")) {
+            run("mkdir -p $outdir/unity");
+        }
+        $uextras = ($ipaths ? " -I" . implode(" -I", $ipaths) : "") . ($extras ? " $extras" : "");
+        foreach (array_chunk($cfiles, (int)ceil(count($cfiles) / $unity)) as $i => $chunk) {
+            $ufile = "$outdir/unity/" . str_replace("/", "_", $folder) . "_$i.cpp";
+            $content = "";
+            foreach ($chunk as $cfile) {
+                $content .= "#include \"" . realpath($cfile) . "\"\n";
+            }
+            if (!file_exists($ufile) || file_get_contents($ufile) !== $content) {
+                file_put_contents($ufile, $content);
             }
+            $ofile = replace_extension($ufile, $outext);
+            $own_ofiles[] = $ofile;
+            $compiles[$ofile] = $with_pch($ufile, [
+                'source' => $ufile,
+                'cmd' => "g++ $copts -MMD -MP -c $ufile -o $ofile" . $uextras,
+                'dfile' => replace_extension($ofile, "d"),
+            ]);
         }
-        
-        run("g++ $copts -c $cfile -o $ofile $extras");
+        $cfiles = [];
+    }
+
+    foreach ($cfiles as $cfile) {
+        $ofile = "$outdir/" . replace_extension($cfile, $outext);
+        $own_ofiles[] = $ofile;
+
+        // only make when modified (or any included header modified, see build_run)
+        $compiles[$ofile] = $with_pch($cfile, [
+            'source' => $cfile,
+            'cmd' => "g++ $copts -MMD -MP -c $cfile -o $ofile $extras",
+            'dfile' => replace_extension($ofile, "d"),
+        ]);
     }
-    $ipaths = array_unique($ipaths);
 
+    $link = [];
     if ($maincpp) {
         $extras = 
             ($ipaths ? " -I" . implode(" -I", $ipaths) : "") .
             ($extras ? " $extras" : "");
 
-        hlight("Compiling the main file...");
-        run(
-            "g++ $copts -c $folder/$maincpp -o $outdir/$mainexe.$outext"
-            . $extras
-        );
+        $compiles["$outdir/$mainexe.$outext"] = $with_pch("$folder/$maincpp", [
+            'source' => "$folder/$maincpp",
+            'cmd' => "g++ $copts -MMD -MP -c $folder/$maincpp -o $outdir/$mainexe.$outext" . $extras,
+            'dfile' => "$outdir/$mainexe.d",
+        ]);
+
+        $allofiles = array_merge(["$outdir/$mainexe.$outext"], $ofiles, $own_ofiles);
+        $link["$outdir/$mainexe"] = [
+            'cmd' => "g++ $copts -o $outdir/$mainexe " . implode(" ", $allofiles) . $extras,
+            'deps' => $allofiles,
+        ];
+    }
+
+    return [
+        'folder' => $folder,
+        'pchs' => $pch_rules,
+        'compiles' => $compiles,
+        'link' => $link,
+        'ofiles' => array_merge($ofiles, $own_ofiles),
+    ];
+}
+
+// Collects the commands of the stale targets, a target is stale when its command
+// changed or any of its dependencies (.d file and explicit deps) is newer.
+function stale_targets($rules)
+{
+    clearstatcache();
+    $cmds = [];
+    foreach ($rules as $target => $rule) {
+        $deps = isset($rule['dfile']) ? read_deps($rule['dfile']) : [];
+        if ($deps !== null) {
+            $deps = array_merge($deps, $rule['deps'] ?? []);
+        }
+        if (!is_up_to_date($target, $deps, $rule['cmd'])) {
+            $cmds[$target] = $rule['cmd'];
+        }
+    }
+    return $cmds;
+}
+
+// Runs the commands of the targets in parallel and saves the commands for the next up-to-date check.
+// Returns the run times (seconds) by the targets that were made.
+function make_targets($cmds, $jobs, $title)
+{
+    if (!$cmds) {
+        hlight("$title: up to date.");
+        return [];
+    }
+    hlight("$title (" . count($cmds) . " jobs, $jobs in parallel)...");
+    run_parallel($cmds, $jobs, true, $times);
+    foreach ($cmds as $target => $cmd) {
+        file_put_contents("$target.cmd", $cmd);
+    }
+    return $times;
+}
+
+// The files of an object that get cached (the dependency file, the coverage notes and the object itself),
+// the object is the last one: an entry is complete when its object exists
+function cache_files($target)
+{
+    return [
+        'd' => replace_extension($target, "d"),
+        'gcno' => replace_extension($target, "gcno"),
+        'o' => $target,
+    ];
+}
+
+// Copies through a temporary file renamed into place, so a concurrent or interrupted
+// build never sees a partial file (the temporary names are hidden from the cache globs)
+function cache_copy($from, $to)
+{
+    $tmp = dirname($to) . "/." . basename($to) . "." . getmypid();
+    if (!@copy($from, $tmp)) {
+        @unlink($tmp);
+        return false;
+    }
+    return rename($tmp, $to);
+}
 
-        hlight("Link objects to executable...");
-        run("g++ $copts -o $outdir/$mainexe $outdir/$mainexe.$outext"
-            . ($ofiles ? " " . implode(" ", $ofiles) : "")
-            . $extras
+// Restores the objects from the cache when there is an entry with the same key,
+// the key is the hash of the preprocessed source, the compiler version and the full command.
+// Returns the commands of the objects have to be compiled and their cache keys in $keys.
+function cache_restore($cmds, $jobs, $cache, &$keys = null, &$stats = null)
+{
+    static $compiler = null;
+    if ($compiler === null) {
+        $compiler = (string)shell_exec("g++ --version 2>&1") . (string)shell_exec("g++ -dumpmachine 2>&1");
+    }
+    if (!is_dir($cache['dir'])) {
+        run("mkdir -p {$cache['dir']}");
+    }
+
+    $preprocs = [];
+    foreach ($cmds as $target => $cmd) {
+        $preprocs[$target] = str_replace(
+            [" -MMD -MP ", " -c ", " -o $target "],
+            [" ", " -E ", " -o $target.ii "],
+            "$cmd "
         );
     }
+    hlight("Preprocessing for compile cache (" . count($preprocs) . " jobs, $jobs in parallel)...");
+    run_parallel($preprocs, $jobs);
+
+    $keys = [];
+    $misses = [];
+    foreach ($cmds as $target => $cmd) {
+        $key = sha1($compiler . "\n" . $cmd . "\n" . file_get_contents("$target.ii"));
+        unlink("$target.ii");
+        $entry = "{$cache['dir']}/$key";
+        // a copy fails when a concurrent build evicted the entry in the meantime: a miss then
+        $restored = file_exists("$entry.o");
+        foreach (cache_files($target) as $ext => $file) {
+            if ($restored && ($ext === 'o' || file_exists("$entry.$ext"))) {
+                $restored = cache_copy("$entry.$ext", $file);
+                @touch("$entry.$ext");
+            }
+        }
+        if (!$restored) {
+            $keys[$target] = $key;
+            $misses[$target] = $cmd;
+            continue;
+        }
+        file_put_contents("$target.cmd", $cmd);
+        echo "cache hit: $target\n";
+    }
+    $stats['hits'] = ($stats['hits'] ?? 0) + count($cmds) - count($misses);
+    $stats['misses'] = ($stats['misses'] ?? 0) + count($misses);
+    return $misses;
+}
+
+// Stores the freshly compiled objects into the cache,
+// then evicts the least recently used entries above the size limit
+function cache_store($keys, $cache, $stats)
+{
+    foreach ($keys as $target => $key) {
+        foreach (cache_files($target) as $ext => $file) {
+            if (file_exists($file)) {
+                cache_copy($file, "{$cache['dir']}/$key.$ext");
+            }
+        }
+    }
+
+    clearstatcache();
+    $entries = [];
+    $size = 0;
+    foreach (glob("{$cache['dir']}/*") as $file) {
+        $key = pathinfo($file, PATHINFO_FILENAME);
+        $entries[$key] = max($entries[$key] ?? 0, filemtime($file));
+        $size += filesize($file);
+    }
+    asort($entries);
+    $evicted = 0;
+    foreach (array_keys($entries) as $key) {
+        if ($size <= $cache['size']) {
+            break;
+        }
+        foreach (glob("{$cache['dir']}/$key.*") as $file) {
+            $size -= filesize($file);
+            unlink($file);
+        }
+        $evicted++;
+    }
+
+    $total = $stats['hits'] + $stats['misses'];
+    hlight(sprintf(
+        "Compile cache: %d hits, %d misses (%.1f%%), %d evicted, %.1f MB / %.1f MB in %s",
+        $stats['hits'], $stats['misses'], $total ? 100 * $stats['hits'] / $total : 0, $evicted,
+        $size / 1048576, $cache['size'] / 1048576, $cache['dir']
+    ));
+}
+
+// Builds the precompiled headers first, then compiles every object of the given
+// plans in one job pool (restoring what it can from the cache), 
+// then links the executables after all the objects are done.
+function build_run($plans, $jobs = 1, $cache = null)
+{
+    $pchs = array_merge([], ...array_column($plans, 'pchs'));
+    $times = make_targets(stale_targets($pchs), $jobs, "Precompiling headers");
+    foreach ($times as $gch => $time) {
+        file_put_contents("$gch.time", (string)$time);
+    }
+
+    $compiles = array_merge([], ...array_column($plans, 'compiles'));
+    $cmds = stale_targets($compiles);
+    if ($cache && $cmds) {
+        $cmds = cache_restore($cmds, $jobs, $cache, $keys, $stats);
+    }
+    $times = make_targets($cmds, $jobs, "Compiling source files");
+    $made = ['compiled' => count($times), 'total' => count($compiles)];
+    if ($cache && isset($stats)) {
+        cache_store($keys, $cache, $stats);
+    }
+    $headers = [];
+    foreach ($times as $target => $time) {
+        $pch = $compiles[$target]['pch'] ?? null;
+        if ($pch && file_exists("{$pch['gch']}.time")) {
+            $headers[$pch['header']]['cost'] = (float)file_get_contents("{$pch['gch']}.time");
+            $headers[$pch['header']]['tus'] = ($headers[$pch['header']]['tus'] ?? 0) + 1;
+        }
+    }
+    if ($headers) {
+        $lines = [];
+        foreach ($headers as $header => $pch) {
+            $lines[] = sprintf("  %s: %.2fs, used by %d compiled TUs", $header, $pch['cost'], $pch['tus']);
+        }
+        hlight("Precompiled headers (the compile time of the header, not a measured saving):\n" . implode("\n", $lines));
+    }
+
+    $links = array_merge([], ...array_column($plans, 'link'));
+    make_targets(stale_targets($links), $jobs, "Link objects to executable");
 
-    return $ofiles;
+    return $made;
+}
+
+// Saves the time of a full build (every source compiled) and compares it
+// to the last full build of the other mode (unity/normal) with the same flags
+function report_build_time($key, $mode, $time, $file = ".build-times.json")
+{
+    $times = file_exists($file) ? json_decode(file_get_contents($file), true) : [];
+    $times[$key][$mode] = $time;
+    file_put_contents($file, json_encode($times, JSON_PRETTY_PRINT));
+
+    $other = $mode === "unity" ? "normal" : "unity";
+    $msg = sprintf("Full %s build: %.2fs", $mode, $time);
+    if (isset($times[$key][$other])) {
+        $diff = $time - $times[$key][$other];
+        $msg .= sprintf(", last full %s build: %.2fs (%+.2fs, %+.1f%%)", 
+            $other, $times[$key][$other], $diff, 100 * $diff / $times[$key][$other]);
+    }
+    hlight($msg);
+}
+
+function build(
+    $folder, $copts = "-std=c++17 -Wall -Wextra -Werror -Wpedantic -O3", $outext = "o", 
+    $maincpp = "main.cpp", $mainexe = "main", $extras = "", $ofiles = [], $outdir = "build", $jobs = 1, $pchs = [], $cache = null, $unity = 0
+) {
+    $plan = build_plan($folder, $copts, $outext, $maincpp, $mainexe, $extras, $ofiles, $outdir, $pchs, $unity);
+    build_run([$plan], $jobs, $cache);
+    return $plan['ofiles'];
+}
+
+
+// Builds src (and tests) into $outdir, src and tests are compiled in the same job pool,
+// tests only needs the src objects at link time. Reports the time of full builds.
+function build_all($copts, $tests, $coverage, $cppfile, $extras, $outdir, $pchs, $unity, $jobs, $cache)
+{
+    $plans = [build_plan("src", $copts, "o", $cppfile ?? "main.cpp", "main", $extras, [], $outdir, $pchs, $unity)];
+    if ($tests) {
+        $plans[] = build_plan("tests", $copts . ($coverage ? " -fprofile-arcs -ftest-coverage" : ""), "o", $cppfile ?? "tests.cpp", "unittests", $extras, $plans[0]['ofiles'], $outdir, $pchs, $unity);
+    }
+    $start = microtime(true);
+    $made = build_run($plans, $jobs, $cache);
+    if ($made['compiled'] === $made['total']) {
+        report_build_time(md5($copts . ($tests ? " tests" : "")), $unity ? "unity" : "normal", microtime(true) - $start);
+    }
+}
+
+// Best wall time (seconds) of a few runs of a command
+function bench_cmd($cmd, $runs = 3)
+{
+    $best = INF;
+    for ($i = 0; $i < $runs; $i++) {
+        $start = microtime(true);
+        run($cmd, $results, true);
+        $best = min($best, microtime(true) - $start);
+    }
+    return $best;
+}
+
+// Profile-guided + LTO release build: instrumented build, training run,
+// then the optimized build with the profile. The profile is kept in $profdir 
+// and reused by the next runs until $retrain. The result is compared to
+// a plain -O3 build (into $outdir/o3) by binary size and the time of the training run.
+function build_pgo($copts, $tests, $cppfile, $extras, $outdir, $pchs, $unity, $jobs, $cache, $profdir, $train, $retrain)
+{
+    $exe = $tests ? "unittests" : "main";
+    $args = $train ? " $train" : "";
+
+    hlight("PGO: plain -O3 build to compare with...");
+    build_all($copts, $tests, false, $cppfile, $extras, "$outdir/o3", $pchs, $unity, $jobs, $cache);
+
+    if ($retrain || !rglob("$profdir/*.gcda")) {
+        hlight("PGO: instrumented build...");
+        run("rm -rf $profdir");
+        run("mkdir -p $profdir");
+        build_all("$copts -fprofile-generate=$profdir -fprofile-update=atomic", $tests, false, $cppfile, $extras, $outdir, $pchs, $unity, $jobs, $cache);
+        hlight("PGO: training run...");
+        run("$outdir/$exe$args");
+    } else {
+        hlight("PGO: using the cached profile from $profdir (use --pgo-retrain to train again)");
+    }
+
+    // the compile cache can not see the profile changes so it is not used here,
+    // functions changed since the training simply lose their profile (coverage-mismatch)
+    hlight("PGO: optimized build with the profile and LTO...");
+    build_all(
+        "$copts -fprofile-use=$profdir -fprofile-correction -Wno-missing-profile -Wno-coverage-mismatch -flto=auto", 
+        $tests, false, $cppfile, $extras, $outdir, $pchs, $unity, $jobs, null
+    );
+
+    hlight("PGO: benchmarking against plain -O3...");
+    $size_o3 = filesize("$outdir/o3/$exe");
+    $size_pgo = filesize("$outdir/$exe");
+    $time_o3 = bench_cmd("$outdir/o3/$exe$args");
+    $time_pgo = bench_cmd("$outdir/$exe$args");
+    hlight(sprintf(
+        "PGO+LTO vs plain -O3 ($exe$args):\n  size: %d -> %d bytes (%+.1f%%)\n  time: %.3fs -> %.3fs (%+.1f%%)",
+        $size_o3, $size_pgo, 100 * ($size_pgo - $size_o3) / $size_o3,
+        $time_o3, $time_pgo, 100 * ($time_pgo - $time_o3) / $time_o3
+    ), COLOR_SUCCESS);
+}
+
+
+// Test groups affected by the changes of the git working tree (git status):
+// a test header is affected when it or any header it includes changed (g++ -MM).
+// Returns null when all the tests should run (the test main changed).
+function changed_test_groups($extras, $outdir)
+{
+    run("git rev-parse --show-toplevel", $results, true);
+    $root = trim($results['output']);
+    run("git status --porcelain --untracked-files=all", $results, true);
+    $changed = [];
+    foreach (preg_split('/\n/', $results['output'], -1, PREG_SPLIT_NO_EMPTY) as $line) {
+        $file = substr($line, 3);
+        if (strpos($file, " -> ") !== false) {
+            $file = explode(" -> ", $file)[1]; // renamed
+        }
+        $changed[] = "$root/" . trim($file, '"');
+    }
+    if (in_array(realpath("tests/tests.cpp"), $changed)) {
+        return null;
+    }
+
+    $groups = [];
+    foreach (rglob("tests/*.h") as $header) {
+        if (!preg_match_all('/^\s*(?:TEST_CASE|TEST_CASE_SERIAL|BENCH_CASE)\(\s*(\w+)/m', file_get_contents($header), $matches)) {
+            continue;
+        }
+        // through stdin so the #pragma once is not in the main file
+        run("echo '#include \"$header\"' | g++ -std=c++17 $extras -MM -MF $outdir/changed.d -x c++ -", $results, true);
+        foreach (read_deps("$outdir/changed.d") ?? [] as $dep) {
+            if (in_array(realpath($dep), $changed)) {
+                $groups = array_merge($groups, $matches[1]);
+                break;
+            }
+        }
+    }
+    return array_values(array_unique($groups));
 }
 
 
@@ -144,7 +827,7 @@ function clean($outdir)
     }
 }
 
-function builder($argv, $outdir = 'build', $copts = "-std=c++17 -Wall -Wextra -Werror -Wpedantic", $excludes = null, $extras = "")
+function builder($argv, $outdir = 'build', $copts = "-std=c++17 -Wall -Wextra -Werror -Wpedantic", $excludes = null, $extras = "", $pchs = [], $cache = null)
 {
     if (in_array("--help", $argv) || in_array("-h", $argv)) {
         hlight("Help:");
@@ -156,6 +839,22 @@ function builder($argv, $outdir = 'build', $copts = "-std=c++17 -Wall -Wextra -W
   --tests or -t: build tests, otherwise builds main executable
   --exec or -e: executes tests or main command after build
   --main or -m: set main/test .cpp filename. eg: --main program.cpp
+  --jobs or -j: number of parallel compile jobs (default: number of cores). eg: --jobs 8
+  --no-pch: do not use precompiled headers
+  --unity: unity (jumbo) build, compiles the sources in N combined translation units (default N is the jobs). eg: --unity 4
+           (intended for release builds, the sources must not define colliding static symbols)
+  --profile-build: records time and peak memory of the compile/link commands and reports the slowest ones
+           and the most expensive headers, the JSON report is saved into build/build-profile.json or to the given file
+           eg: --profile-build profile.json
+  --profile-trace: same as --profile-build but also collects the compiler time reports (-ftime-report)
+  --no-cache: do not use the compile cache (see \$cache_dir and \$cache_size in build.conf.php)
+  --pgo: profile-guided + LTO release build: instrumented build, training run (the unittests with -t or the main),
+           then the optimized build using the profile, compared to a plain -O3 build
+           (the profile is cached in \$cache_dir/pgo, no coverage info for the tests)
+  --pgo-train: arguments of the training run. eg: --pgo-train \"--input data.txt\"
+  --pgo-retrain: drop the cached profile and train again
+  --changed: runs only the tests affected by the changes of the git working tree
+           (the test headers including a changed file, no coverage report)
 ";
         return;
     }
@@ -166,48 +865,95 @@ function builder($argv, $outdir = 'build', $copts = "-std=c++17 -Wall -Wextra -W
         $cppfile = $argv[$main_at + 1];
     }
 
+    $jobs_at = array_search("--jobs", $argv);
+    if ($jobs_at === false) $jobs_at = array_search("-j", $argv);
+    $jobs = $jobs_at !== false ? max(1, (int)($argv[$jobs_at + 1] ?? 1)) : cpu_count();
+
+    $pchs = in_array("--no-pch", $argv) ? [] : array_unique(array_merge(["src/lib/utils.h", "tests/Test.h"], $pchs));
+
+    $changed = in_array("--changed", $argv);
+
+    $pgo = in_array("--pgo", $argv);
+    $pgo_at = array_search("--pgo-train", $argv);
+    $pgo_train = $pgo_at !== false ? $argv[$pgo_at + 1] : "";
+    $pgo_dir = ($cache['dir'] ?? "$outdir") . "/pgo/" . md5(realpath(".") . $copts . $extras);
+
+    if (in_array("--no-cache", $argv)) {
+        $cache = null;
+    }
+
+    $profile_at = array_search("--profile-build", $argv);
+    if ($profile_at === false) $profile_at = array_search("--profile-trace", $argv);
+    if ($profile_at !== false) {
+        $profile = &build_profile();
+        $profile = [
+            'file' => preg_match('/\.json$/', $argv[$profile_at + 1] ?? "") ? $argv[$profile_at + 1] : "$outdir/build-profile.json",
+            'trace' => in_array("--profile-trace", $argv),
+            'records' => [],
+        ];
+    }
+
+    $unity_at = array_search("--unity", $argv);
+    $unity = 0;
+    if ($unity_at !== false) {
+        $unity = is_numeric($argv[$unity_at + 1] ?? null) ? max(1, (int)$argv[$unity_at + 1]) : $jobs;
+    }
+
     if (in_array("--clean", $argv) || in_array("-c", $argv)) {
         clean($outdir);
     }
 
+    // --pgo is a release build
+    $release = in_array("--release", $argv) || in_array("-r", $argv) || $pgo;
+    $debug = in_array("--debug", $argv) || in_array("-d", $argv);
+    $tests = in_array("--tests", $argv) || in_array("-t", $argv);
+
     if (
         (!in_array("--clean", $argv) && !in_array("-c", $argv)) &&
-        (!in_array("--release", $argv) && !in_array("-r", $argv)) &&
-        (!in_array("--debug", $argv) && !in_array("-d", $argv))
+        !$release && !$debug
     ) {
         echo "At least one should say debug or release or only cleanup? (use -d or -r or -c or --help for more infos)\n";
         return -1;
     }
 
-    if (
-        (in_array("--release", $argv) || in_array("-r", $argv)) &&
-        (in_array("--debug", $argv) || in_array("-d", $argv))
-    ) {
+    if ($release && $debug) {
         echo "Exactly one should say debug or release? (use -d or -r or --help for more infos)\n";
         return -1;
     }
 
-    if (
-        (in_array("--release", $argv) || in_array("-r", $argv)) ||
-        (in_array("--debug", $argv) || in_array("-d", $argv))
-    ) {
-        if (in_array("--release", $argv) || in_array("-r", $argv)) {
+    if ($release || $debug) {
+        if ($release) {
             $copts .= " -O3";
         }
-        if (in_array("--debug", $argv) || in_array("-d", $argv)) {
+        if ($debug) {
             $copts .= " -O0 -g";
         }
 
         if ($copts) {
-            $ofiles = build("src", $copts, "o", $cppfile ?? "main.cpp", "main", $extras);
-            if (in_array("--tests", $argv) || in_array("-t", $argv)) {
-                build("tests", $copts . " -fprofile-arcs -ftest-coverage", "o", $cppfile ?? "tests.cpp", "unittests", $extras, $ofiles);
+            if ($pgo) {
+                build_pgo($copts, $tests, $cppfile ?? null, $extras, $outdir, $pchs, $unity, $jobs, $cache, 
+                    $pgo_dir, $pgo_train, in_array("--pgo-retrain", $argv));
+            } else {
+                build_all($copts, $tests, true, $cppfile ?? null, $extras, $outdir, $pchs, $unity, $jobs, $cache);
+            }
+            if ($profile_at !== false) {
+                profile_report();
+            }
 
-                if (in_array("--exec", $argv) || in_array("-e", $argv)) {
+            if ($tests) {
+                $groups = $changed ? changed_test_groups($extras, $outdir) : null;
+                if ($groups !== null) {
+                    hlight("Tests affected by the changes: " . ($groups ? implode(", ", $groups) : "none"));
+                }
+                if ((in_array("--exec", $argv) || in_array("-e", $argv)) && $groups !== []) {
+                    $filter = $groups ? " --filter " . escapeshellarg(implode(",", $groups)) : "";
                     hlight("Running unit tests:");
                     // run("node tests/mock_wssrv/index.mjs &");
-                    run("$outdir/unittests");
+                    run("$outdir/unittests -j $jobs$filter");
                     hlight("Test passed", COLOR_SUCCESS);
+                }
+                // partial runs would report partial coverage
+                if (!$pgo && !$changed && (in_array("--exec", $argv) || in_array("-e", $argv))) {
                     hlight("Generating coverage info...");
                     run("lcov --no-external --directory . --capture --output-file coverage.info");
                     if (is_array($excludes)) {
@@ -266,6 +1012,11 @@ try {
     return builder($argv, 'build', "-std=c++17 -Wall -Wextra -Werror -Wpedantic", 
         $excludes,
         implode(" ", $extras),
+        $pchs ?? [],
+        [
+            'dir' => $cache_dir ?? getenv("HOME") . "/.cache/cbuild",
+            'size' => ($cache_size ?? 1024) * 1048576,
+        ],
     );
 } catch (Throwable $e) {
     $eCode = $e->getCode();
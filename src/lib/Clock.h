@@ -3,6 +3,8 @@
 #include <ctime>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <mutex>
 #include "utils.h"
 
 using namespace std;
@@ -11,26 +13,166 @@ namespace lib {
 
     #define CLK_REAL 0ul
     #define CLK_NULL -1ul
+    #define CLK_NULL_NS -1ull
+
+    #define CLK_NS_PER_MS 1000000ull
+
+    #define CLK_COARSE_KERNEL 1ul
 
     class Clock
     {
+    public:
+        // Source of the coarse real time for the hot paths: a ticker thread publishes the time at every tick_ms
+        // (Clock::now() is a virtual call and a relaxed atomic load then), or with tick_ms = 0 the time comes from CLOCK_REALTIME_COARSE
+        // (kernel tick resolution, no thread). The time can be behind by a tick. A clock reads the one
+        // given to its constructor, or the process-wide one of startCoarse().
+        class Ticker {
+        protected:
+            // the published time, CLK_REAL when stopped or CLK_COARSE_KERNEL for CLOCK_REALTIME_COARSE
+            atomic<unsigned long> ms{ CLK_REAL };
+            atomic<unsigned long> tick{ 0 };
+            thread worker;
+            atomic<bool> running{ false };
+            mutex lock;
+
+            void join() {
+                running = false;
+                if (worker.joinable()) worker.join();
+            }
+
+        public:
+            Ticker() {}
+
+            explicit Ticker(unsigned long tick_ms) {
+                start(tick_ms);
+            }
+
+            ~Ticker() {
+                stop();
+            }
+
+            void start(unsigned long tick_ms = 1) {
+                lock_guard<mutex> guard(lock);
+                join();
+                if (!tick_ms) {
+                    timespec res;
+                    clock_getres(CLOCK_REALTIME_COARSE, &res);
+                    tick = max(1ul, (unsigned long)(res.tv_sec * 1000 + (res.tv_nsec + 999999) / 1000000));
+                    ms = CLK_COARSE_KERNEL;
+                    return;
+                }
+                tick = tick_ms;
+                ms = system_ms();
+                running = true;
+                worker = thread([this, tick_ms]() {
+                    while (running.load(memory_order_relaxed)) {
+                        this_thread::sleep_for(chrono::milliseconds(tick_ms));
+                        ms.store(system_ms(), memory_order_relaxed);
+                    }
+                });
+            }
+
+            void stop() {
+                lock_guard<mutex> guard(lock);
+                join();
+                ms = CLK_REAL;
+                tick = 0;
+            }
+
+            bool isRunning() const {
+                return ms != CLK_REAL;
+            }
+
+            // ms, how much the time can be behind (0 when stopped)
+            unsigned long getTick() const {
+                return isRunning() ? tick.load() : 0;
+            }
+
+            // the coarse time, CLK_REAL when stopped
+            unsigned long now() const {
+                unsigned long coarse = ms.load(memory_order_relaxed);
+                if (coarse == CLK_COARSE_KERNEL) {
+                    timespec now;
+                    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+                    return now.tv_sec * 1000ul + now.tv_nsec / 1000000ul;
+                }
+                return coarse;
+            }
+        };
+
     protected:
         unsigned long ts = CLK_NULL;
+        unsigned long long ts_ns = 0; // sub-millisecond part of the fake time
+        const Ticker* coarse = nullptr; // of a real clock, the process-wide one when not set
+
+        static Ticker& ticker() {
+            static Ticker ticker;
+            return ticker;
+        }
+
+        static unsigned long system_ms() {
+            return chrono::time_point_cast<chrono::milliseconds>(chrono::system_clock::now())
+                .time_since_epoch()
+                .count();
+        }
+
     public:
         // ts = 0 means it's a real clock
         Clock(unsigned long ts = CLK_REAL): ts(ts) {}
 
-        unsigned long now() const {
+        // a real clock reading the coarse time of the ticker (regardless of the process-wide coarse mode)
+        explicit Clock(const Ticker& coarse): ts(CLK_REAL), coarse(&coarse) {}
+
+        virtual ~Clock() {}
+
+        virtual unsigned long now() const {
             if (ts == CLK_REAL) {
-                unsigned long _now = chrono::time_point_cast<chrono::milliseconds>(chrono::system_clock::now())
-                    .time_since_epoch()
-                    .count();
-                return _now;
+                unsigned long ms = (coarse ? *coarse : ticker()).now();
+                return ms != CLK_REAL ? ms : system_ms();
             }
             return ts;
         }
 
-        void delay(unsigned long ms) {
+        // Opt-in process-wide coarse mode of the real clocks without their own ticker (now() and so datef())
+        // for the hot paths, see Ticker. nanos() is not affected. It is for the applications, the tests
+        // give their clocks their own Ticker instead (the other tests may be running at the same time).
+        static void startCoarse(unsigned long tick_ms = 1) {
+            ticker().start(tick_ms);
+        }
+
+        static void stopCoarse() {
+            ticker().stop();
+        }
+
+        static bool isCoarse() {
+            return ticker().isRunning();
+        }
+
+        // a real clock reading a coarse time (its own ticker or the process-wide one)
+        bool isCoarseTime() const {
+            return isReal() && (coarse ? *coarse : ticker()).isRunning();
+        }
+
+        // ms, how much now() can be behind the real time (0 unless isCoarseTime())
+        unsigned long getCoarseTick() const {
+            return isReal() ? (coarse ? *coarse : ticker()).getTick() : 0;
+        }
+
+        virtual bool isReal() const {
+            return ts == CLK_REAL;
+        }
+
+        // nanoseconds from the monotonic steady_clock, only for measuring durations
+        // (the epoch is not the same as of now()), a fake clock gives its time in nanoseconds
+        virtual unsigned long long nanos() const {
+            if (ts == CLK_REAL) {
+                return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+            }
+            if (ts == CLK_NULL) return CLK_NULL_NS;
+            return ts * CLK_NS_PER_MS + ts_ns;
+        }
+
+        virtual void delay(unsigned long ms) {
             if (ts == CLK_REAL) {
                 this_thread::sleep_for(chrono::milliseconds(ms));
                 return;
@@ -38,9 +180,26 @@ namespace lib {
             ts += ms;
         }
 
-        void set(unsigned long _ts) {
+        virtual void delayNanos(unsigned long long ns) {
+            if (ts == CLK_REAL) {
+                this_thread::sleep_for(chrono::nanoseconds(ns));
+                return;
+            }
+            ts_ns += ns;
+            ts += ts_ns / CLK_NS_PER_MS;
+            ts_ns %= CLK_NS_PER_MS;
+        }
+
+        virtual void set(unsigned long _ts) {
             if (ts == CLK_REAL) throw ERROR("Can not set time on real clock");
             ts = _ts;
+            ts_ns = 0;
+        }
+
+        virtual void setNanos(unsigned long long ns) {
+            if (ts == CLK_REAL) throw ERROR("Can not set time on real clock");
+            ts = ns / CLK_NS_PER_MS;
+            ts_ns = ns % CLK_NS_PER_MS;
         }
     };
 
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstring>
+#include <cerrno>
+#include <unordered_map>
+#include <functional>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "Clock.h"
+#include "TimerWheel.h"
+
+using namespace std;
+
+namespace lib {
+
+    // Waits for the timers (see TimerWheel) and the watched file descriptors together:
+    // sleeps in epoll until the next timer deadline (timerfd on the real time) or any I/O.
+    // With a fake Clock it does not sleep for the timers, the clock jumps to the next deadline,
+    // the file descriptors are checked without blocking (blocks only when there are no timers).
+    // Not thread-safe, the callbacks run in the loop.
+    class EventLoop {
+    public:
+        typedef function<void(uint32_t events)> Callback;
+
+    protected:
+        Clock& clock;
+        TimerWheel wheel;
+        int epfd = -1;
+        int tfd = -1;
+        unordered_map<int, Callback> watches;
+        bool stopped = false;
+
+        // waits for the I/O (and the timerfd) up to timeout ms (-1: forever), returns the number of the I/O callbacks
+        size_t poll(int timeout) {
+            epoll_event events[64];
+            int n = epoll_wait(epfd, events, 64, timeout);
+            if (n < 0) {
+                if (errno == EINTR) return 0;
+                throw ERROR("epoll_wait() failed: ", strerror(errno));
+            }
+            size_t handled = 0;
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == tfd) {
+                    uint64_t expirations;
+                    if (read(tfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+                        throw ERROR("timerfd read() failed: ", strerror(errno));
+                    continue;
+                }
+                auto watch = watches.find(fd); // may be unwatched by an earlier callback
+                if (watch == watches.end()) continue;
+                Callback callback = watch->second;
+                callback(events[i].events);
+                handled++;
+            }
+            return handled;
+        }
+
+        // wakes up the epoll_wait() at the time (ms on the real time), CLK_NULL disarms
+        void arm(unsigned long at) {
+            itimerspec spec = {};
+            unsigned long tick = clock.getCoarseTick();
+            if (at != CLK_NULL && tick) {
+                // the coarse now() reaches the deadline up to a tick later than the real time,
+                // and when it's still behind after that, it's checked again a ms later instead of spinning
+                timespec now;
+                clock_gettime(CLOCK_REALTIME, &now);
+                at = max(at + tick, now.tv_sec * 1000ul + now.tv_nsec / 1000000ul + 1);
+            }
+            if (at != CLK_NULL) {
+                spec.it_value.tv_sec = at / 1000;
+                spec.it_value.tv_nsec = (at % 1000) * 1000000;
+            }
+            if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &spec, nullptr))
+                throw ERROR("timerfd_settime() failed: ", strerror(errno));
+        }
+
+    public:
+        EventLoop(Clock& clock, unsigned long tick_ms = 1): clock(clock), wheel(clock, tick_ms) {
+            epfd = epoll_create1(EPOLL_CLOEXEC);
+            if (epfd < 0) throw ERROR("epoll_create1() failed: ", strerror(errno));
+            tfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (tfd < 0) {
+                close(epfd);
+                throw ERROR("timerfd_create() failed: ", strerror(errno));
+            }
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = tfd;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &event);
+        }
+
+        virtual ~EventLoop() {
+            close(tfd);
+            close(epfd);
+        }
+
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        Clock& getClock() const {
+            return clock;
+        }
+
+        TimerWheel& getTimers() {
+            return wheel;
+        }
+
+        TimerWheel::Id schedule(unsigned long ms, function<void()> callback, bool repeat = false, bool force = true) {
+            return wheel.schedule(ms, move(callback), repeat, force);
+        }
+
+        bool cancel(TimerWheel::Id id) {
+            return wheel.cancel(id);
+        }
+
+        // calls back with the epoll events (EPOLLIN, EPOLLOUT..) when the fd is ready, level-triggered
+        void watch(int fd, uint32_t events, Callback callback) {
+            epoll_event event = {};
+            event.events = events;
+            event.data.fd = fd;
+            bool watched = watches.count(fd);
+            if (epoll_ctl(epfd, watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event))
+                throw ERROR("Unable to watch fd ", fd, ": ", strerror(errno));
+            watches[fd] = move(callback);
+        }
+
+        // call it before closing the fd
+        void unwatch(int fd) {
+            if (!watches.erase(fd)) return;
+            epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        }
+
+        // waits for the next timer or I/O but at most timeout ms (-1: no limit) and calls them back,
+        // returns the number of the callbacks (0 when there was nothing to wait for or timed out)
+        size_t runOnce(long timeout = -1) {
+            unsigned long until = timeout < 0 ? CLK_NULL : clock.now() + timeout;
+            for (;;) {
+                size_t handled = wheel.advance();
+                if (handled) return handled;
+
+                unsigned long now = clock.now();
+                if (until != CLK_NULL && now >= until) return 0;
+                unsigned long at = wheel.nextDue(); // can be a cascade of the later timers only
+                if (until != CLK_NULL && (at == CLK_NULL || until < at)) at = until;
+                if (at == CLK_NULL && watches.empty()) return 0;
+
+                if (clock.isReal()) {
+                    arm(at);
+                    handled = poll(-1);
+                } else {
+                    handled = poll(at == CLK_NULL ? -1 : 0);
+                    if (!handled && at != CLK_NULL) clock.set(max(at, now));
+                }
+                if (handled) return handled;
+            }
+        }
+
+        // runs until stop() or while there are timers or watched fds
+        void run() {
+            stopped = false;
+            while (!stopped && (wheel.size() || !watches.empty())) runOnce();
+        }
+
+        void stop() {
+            stopped = true;
+        }
+    };
+
+}
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include "Clock.h"
+#include "datef.h"
+
+using namespace std;
+
+namespace lib {
+
+    #define LOGGER_LEVEL_TRACE 0
+    #define LOGGER_LEVEL_DEBUG 1
+    #define LOGGER_LEVEL_INFO 2
+    #define LOGGER_LEVEL_WARN 3
+    #define LOGGER_LEVEL_ERROR 4
+
+    // the lower levels compile out (define it before including, e.g. -DLOGGER_LEVEL=LOGGER_LEVEL_INFO)
+    #ifndef LOGGER_LEVEL
+    #define LOGGER_LEVEL LOGGER_LEVEL_DEBUG
+    #endif
+
+    #define LOGGER_LOG(logger, level, ...) do { \
+        if constexpr ((level) >= LOGGER_LEVEL) (logger).log((level), __FILE__, __LINE__, __VA_ARGS__); \
+    } while (0)
+
+    #define LOGGER_TRACE(...) LOGGER_LOG(Logger::global(), LOGGER_LEVEL_TRACE, __VA_ARGS__)
+    #define LOGGER_DEBUG(...) LOGGER_LOG(Logger::global(), LOGGER_LEVEL_DEBUG, __VA_ARGS__)
+    #define LOGGER_INFO(...) LOGGER_LOG(Logger::global(), LOGGER_LEVEL_INFO, __VA_ARGS__)
+    #define LOGGER_WARN(...) LOGGER_LOG(Logger::global(), LOGGER_LEVEL_WARN, __VA_ARGS__)
+    #define LOGGER_ERROR(...) LOGGER_LOG(Logger::global(), LOGGER_LEVEL_ERROR, __VA_ARGS__)
+
+    // PRINT and DBG go to the global logger instead of cout when LOGGER_PRINT is defined before including
+    #ifdef LOGGER_PRINT
+    #undef PRINT
+    #undef DBG
+    #define PRINT(...) LOGGER_INFO(__VA_ARGS__);
+    #define DBG(...) LOGGER_DEBUG("(", join(", ", __VA_ARGS__), ")")
+    #endif
+
+    // Asynchronous logger: the logging threads format the lines (timestamp by the Clock and DateFormat,
+    // level, message, file:line) into their own lock-free single-producer/single-consumer byte ring,
+    // a background writer thread drains all the rings and writes the batches to the sink (stdout by default).
+    // A full ring drops the line (counted, see getDropped()) or, with block, waits for the writer.
+    // A thread takes a lock only once, when it logs the first time. Stop the logging threads before
+    // the logger is destroyed, the destructor writes out what's left.
+    class Logger {
+    public:
+        typedef function<void(string_view)> Sink;
+
+    protected:
+        // the bytes [tail, head) are the complete lines waiting for the writer
+        struct Ring {
+            vector<char> data;
+            size_t mask;
+            alignas(64) atomic<size_t> head = { 0 }; // written by the producer
+            alignas(64) atomic<size_t> tail = { 0 }; // written by the consumer
+            atomic<bool> closed = { false }; // the thread is gone
+            atomic<bool> detached = { false }; // the logger is gone
+
+            Ring(size_t size): data(size), mask(size - 1) {}
+
+            bool push(const char* line, size_t len) {
+                size_t h = head.load(memory_order_relaxed);
+                if (data.size() - (h - tail.load(memory_order_acquire)) < len) return false;
+                size_t at = h & mask;
+                size_t first = min(len, data.size() - at);
+                memcpy(&data[at], line, first);
+                memcpy(&data[0], line + first, len - first);
+                head.store(h + len, memory_order_release);
+                return true;
+            }
+
+            bool drain(string& out) {
+                size_t h = head.load(memory_order_acquire);
+                size_t t = tail.load(memory_order_relaxed);
+                if (h == t) return false;
+                size_t at = t & mask;
+                size_t first = min(h - t, data.size() - at);
+                out.append(&data[at], first);
+                out.append(&data[0], h - t - first);
+                tail.store(h, memory_order_release);
+                return true;
+            }
+        };
+
+        // the rings of a thread by the loggers (ids, the rings of the loggers gone are dropped at the next lookup)
+        struct ThreadRings {
+            vector<pair<unsigned long, shared_ptr<Ring>>> rings;
+            string line;
+            DateFormat date;
+
+            ~ThreadRings() {
+                for (auto& ring: rings) ring.second->closed = true;
+            }
+        };
+
+        static inline atomic<unsigned long> ids = { 0 };
+
+        const unsigned long id = ++ids;
+        Sink sink;
+        Clock& clock;
+        size_t ring_size;
+        bool block;
+        atomic<int> level = { LOGGER_LEVEL_TRACE };
+        atomic<size_t> dropped = { 0 };
+        atomic<size_t> logged = { 0 };
+
+        mutex lock; // of the rings and the flushes
+        condition_variable wake;
+        condition_variable flushed;
+        vector<shared_ptr<Ring>> rings;
+        unsigned long flush_requests = 0;
+        unsigned long flush_done = 0;
+        atomic<bool> running = { true };
+        atomic<bool> waiting = { false }; // a blocked producer wakes the writer
+        thread writer;
+
+        static const char* levelName(int level) {
+            static const char* names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR" };
+            return level >= 0 && level <= LOGGER_LEVEL_ERROR ? names[level] : "LOG";
+        }
+
+        static ThreadRings& threadRings() {
+            static thread_local ThreadRings rings;
+            return rings;
+        }
+
+        Ring& ring(ThreadRings& thread_rings) {
+            for (auto& ring: thread_rings.rings) if (ring.first == id) return *ring.second;
+            // a logger new to the thread, a good time to drop the rings of the loggers gone
+            auto& mine = thread_rings.rings;
+            mine.erase(remove_if(mine.begin(), mine.end(), [](auto& ring) { return ring.second->detached.load(); }), mine.end());
+            auto ring = make_shared<Ring>(ring_size);
+            {
+                lock_guard<mutex> guard(lock);
+                rings.push_back(ring);
+            }
+            thread_rings.rings.emplace_back(id, ring);
+            return *ring;
+        }
+
+        // drains the rings into the batch (and forgets the closed ones), false when there was nothing
+        bool drain(string& batch) {
+            lock_guard<mutex> guard(lock);
+            bool drained = false;
+            for (size_t i = 0; i < rings.size(); i++) {
+                bool closed = rings[i]->closed; // before the drain, its last lines are in then
+                drained |= rings[i]->drain(batch);
+                if (closed) rings.erase(rings.begin() + i--);
+            }
+            return drained;
+        }
+
+        void write() {
+            string batch;
+            for (;;) {
+                unsigned long requests;
+                bool stopping;
+                {
+                    lock_guard<mutex> guard(lock);
+                    requests = flush_requests;
+                    stopping = !running;
+                    waiting = false;
+                }
+                batch.clear();
+                while (drain(batch) && batch.size() < 1024 * 1024);
+                if (!batch.empty()) {
+                    sink(batch);
+                    continue; // there may be more
+                }
+                unique_lock<mutex> guard(lock);
+                flush_done = requests;
+                flushed.notify_all();
+                if (stopping) return;
+                wake.wait_for(guard, chrono::milliseconds(10), [&]() { return flush_requests != flush_done || !running || waiting; });
+            }
+        }
+
+        static void writeFd(int fd, string_view data) {
+            while (!data.empty()) {
+                ssize_t n = ::write(fd, data.data(), data.size());
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return; // nowhere to complain
+                data.remove_prefix(n);
+            }
+        }
+
+        static Clock& realClock() {
+            static Clock clock;
+            return clock;
+        }
+
+    public:
+        // ring_size bytes per logging thread (rounded up to a power of 2)
+        Logger(Sink sink, size_t ring_size = 64 * 1024, bool block = false, Clock& clock = realClock())
+            : sink(move(sink)), clock(clock), ring_size(1), block(block) {
+            while (this->ring_size < ring_size) this->ring_size <<= 1;
+            writer = thread(&Logger::write, this);
+        }
+
+        Logger(int fd = STDOUT_FILENO, size_t ring_size = 64 * 1024, bool block = false, Clock& clock = realClock())
+            : Logger([fd](string_view data) { writeFd(fd, data); }, ring_size, block, clock) {}
+
+        virtual ~Logger() {
+            {
+                lock_guard<mutex> guard(lock);
+                running = false;
+            }
+            wake.notify_all();
+            writer.join();
+            // the threads free them when they log next time (to any logger)
+            for (auto& ring: rings) ring->detached = true;
+            rings.clear();
+        }
+
+        Logger(const Logger&) = delete;
+        Logger& operator=(const Logger&) = delete;
+
+        // the logger of the LOGGER_* macros, writes to stdout
+        static Logger& global() {
+            static Logger logger;
+            return logger;
+        }
+
+        // the runtime threshold (above the compile time LOGGER_LEVEL)
+        void setLevel(int level) {
+            this->level = level;
+        }
+
+        int getLevel() const {
+            return level;
+        }
+
+        // false when the line was dropped
+        template <typename... T>
+        bool log(int level, const char* file, int line, const T&... args) {
+            if (level < this->level.load(memory_order_relaxed)) return false;
+            ThreadRings& thread_rings = threadRings();
+            string& text = thread_rings.line;
+            text.resize(32);
+            text.resize(thread_rings.date.format(clock.now(), &text[0], 32));
+            str_append(text, " [", levelName(level), "] ", args..., " ", file, ":", line, "\n");
+
+            Ring& ring = this->ring(thread_rings);
+            while (!ring.push(text.data(), text.size())) {
+                if (!block || text.size() > ring.data.size() || !running) {
+                    dropped++;
+                    return false;
+                }
+                if (!waiting.exchange(true)) {
+                    lock_guard<mutex> guard(lock);
+                    wake.notify_one();
+                }
+                this_thread::yield();
+            }
+            logged++;
+            return true;
+        }
+
+        // waits until the lines logged so far are written
+        void flush() {
+            unique_lock<mutex> guard(lock);
+            unsigned long request = ++flush_requests;
+            wake.notify_all();
+            flushed.wait(guard, [&]() { return flush_done >= request; });
+        }
+
+        size_t getDropped() const {
+            return dropped;
+        }
+
+        size_t getLogged() const {
+            return logged;
+        }
+    };
+
+}
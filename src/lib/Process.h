@@ -0,0 +1,385 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <functional>
+#include <string_view>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <climits>
+#include <spawn.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include "Clock.h"
+
+extern char** environ;
+
+using namespace std;
+
+namespace lib {
+
+    struct ProcessOptions {
+        typedef function<void(string_view)> Sink;
+        typedef function<size_t(char* buff, size_t size)> Producer;
+
+        bool merge_stderr = false; // stderr goes to out too (as exec() does with 2>&1)
+        long timeout_ms = -1; // -1: no limit
+        int kill_signal = SIGKILL; // sent to the process group at the timeout
+
+        // Streaming: the output goes to the callbacks (as it arrives, not collected into the result),
+        // by chunks (views into the read buffer of the Process, valid during the call) or by lines without
+        // the '\n' (the last one may not end with it)
+        Sink on_out;
+        Sink on_err;
+        bool lines = false;
+
+        // fills the buffer with the next part of stdin, returns the size, 0 at the end (stdin is /dev/null
+        // without it). It's called again when the pipe has room (the pipe buffer bounds what's pending).
+        Producer on_stdin;
+    };
+
+    struct ProcessResult {
+        int status = -1; // exit code, 128 + signal when it was killed by a signal, -1 when it didn't start
+        int signal = 0;
+        bool timed_out = false;
+        string out;
+        string err;
+        string error; // why it didn't start
+        unsigned long started = 0; // ms (Clock::now())
+        unsigned long long elapsed_ns = 0;
+    };
+
+    // Child process by posix_spawnp() without a shell (see Process::shell() for one), stdin is /dev/null
+    // or a non-blocking pipe from ProcessOptions::on_stdin, stdout and stderr are read separately from
+    // non-blocking pipes by 64 KB chunks (into the result, or to the on_out/on_err callbacks in bounded
+    // memory). The child gets its own process group, so kill() and the timeout reach its children too.
+    // The processes are multiplexed by one poll() loop (see exec_many() for running more at once).
+    // The destructor kills and reaps a still running child.
+    class Process {
+    protected:
+        ProcessOptions options;
+        ProcessResult result;
+        pid_t pid = 0; // 0 when it's reaped (or didn't start)
+        int out_fd = -1;
+        int err_fd = -1;
+        int pid_fd = -1; // readable at the exit (Linux 5.3+)
+        int in_fd = -1;
+        vector<char> out_buffer; // the reads of stdout and stderr (own, a sink may run an other Process)
+        vector<char> in_buffer; // the part of stdin from the producer
+        string_view in_pending; // not written yet
+        string out_line; // the incomplete lines of the line mode
+        string err_line;
+        unsigned long long started_ns;
+        bool killed = false;
+
+        static void closeFd(int& fd) {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+
+        void deliver(string_view chunk, string& into, const ProcessOptions::Sink& sink, string& line) {
+            if (!sink) {
+                into.append(chunk);
+                return;
+            }
+            if (!options.lines) {
+                sink(chunk);
+                return;
+            }
+            const char* end = chunk.data() + chunk.size();
+            for (const char* p = chunk.data(); p < end;) {
+                const char* eol = split_find(p, end, '\n');
+                if (eol == end) {
+                    line.append(p, end - p);
+                    return;
+                }
+                if (line.empty()) sink(string_view(p, eol - p));
+                else {
+                    line.append(p, eol - p);
+                    sink(line);
+                    line.clear();
+                }
+                p = eol + 1;
+            }
+        }
+
+        // reads what's available, closes the fd at EOF
+        void read(int& fd, string& into, const ProcessOptions::Sink& sink, string& line) {
+            for (;;) {
+                ssize_t n = ::read(fd, out_buffer.data(), out_buffer.size());
+                if (n > 0) {
+                    deliver(string_view(out_buffer.data(), n), into, sink, line);
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && errno == EAGAIN) return;
+                closeFd(fd);
+                if (!line.empty()) {
+                    sink(line);
+                    line.clear();
+                }
+                return;
+            }
+        }
+
+        // writes stdin from the producer until the pipe is full, closes it at the end (or when the child closed it)
+        void feed() {
+            sigset_t sigpipe, mask;
+            sigemptyset(&sigpipe);
+            sigaddset(&sigpipe, SIGPIPE);
+            pthread_sigmask(SIG_BLOCK, &sigpipe, &mask); // EPIPE instead of killing us
+            for (;;) {
+                if (in_pending.empty()) {
+                    size_t size = options.on_stdin(in_buffer.data(), in_buffer.size());
+                    if (!size) break;
+                    in_pending = string_view(in_buffer.data(), min(size, in_buffer.size()));
+                }
+                ssize_t n = ::write(in_fd, in_pending.data(), in_pending.size());
+                if (n > 0) {
+                    in_pending.remove_prefix(n);
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && errno == EAGAIN) {
+                    pthread_sigmask(SIG_SETMASK, &mask, nullptr);
+                    return;
+                }
+                if (n < 0 && errno == EPIPE) {
+                    timespec zero = { 0, 0 };
+                    sigtimedwait(&sigpipe, nullptr, &zero); // the pending SIGPIPE
+                }
+                break;
+            }
+            pthread_sigmask(SIG_SETMASK, &mask, nullptr);
+            closeFd(in_fd);
+        }
+
+        void finish(int wstatus) {
+            pid = 0;
+            if (WIFEXITED(wstatus)) result.status = WEXITSTATUS(wstatus);
+            else if (WIFSIGNALED(wstatus)) {
+                result.signal = WTERMSIG(wstatus);
+                result.status = 128 + result.signal;
+            }
+            result.elapsed_ns = Clock().nanos() - started_ns;
+        }
+
+        // reaps the child when its output is closed
+        void reap() {
+            if (!pid || out_fd >= 0 || err_fd >= 0) return;
+            int wstatus;
+            pid_t done = waitpid(pid, &wstatus, WNOHANG);
+            if (done == pid) {
+                finish(wstatus);
+                closeFd(pid_fd);
+                closeFd(in_fd);
+            }
+            else if (done < 0 && errno != EINTR) pid = 0; // LCOV_EXCL_LINE
+        }
+
+        long remaining(unsigned long long now) const {
+            if (options.timeout_ms < 0 || killed) return -1;
+            long long left = (long long)(started_ns + options.timeout_ms * CLK_NS_PER_MS) - (long long)now;
+            return left <= 0 ? 0 : (left + CLK_NS_PER_MS - 1) / CLK_NS_PER_MS;
+        }
+
+    public:
+        Process(const vector<string>& argv, const ProcessOptions& options = ProcessOptions()): options(options) {
+            Clock clock;
+            result.started = clock.now();
+            started_ns = clock.nanos();
+            if (argv.empty()) {
+                result.error = "empty command";
+                return;
+            }
+            int outs[2], errs[2] = { -1, -1 }, ins[2] = { -1, -1 };
+            if (pipe2(outs, O_CLOEXEC) || (!options.merge_stderr && pipe2(errs, O_CLOEXEC)) ||
+                (options.on_stdin && pipe2(ins, O_CLOEXEC))) {
+                result.error = strerror(errno); // LCOV_EXCL_LINE
+                return; // LCOV_EXCL_LINE
+            }
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            if (options.on_stdin) posix_spawn_file_actions_adddup2(&actions, ins[0], STDIN_FILENO);
+            else posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+            posix_spawn_file_actions_adddup2(&actions, outs[1], STDOUT_FILENO);
+            posix_spawn_file_actions_adddup2(&actions, options.merge_stderr ? outs[1] : errs[1], STDERR_FILENO);
+            posix_spawnattr_t attr;
+            posix_spawnattr_init(&attr);
+            posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+            posix_spawnattr_setpgroup(&attr, 0);
+
+            vector<char*> args;
+            for (const string& arg: argv) args.push_back(const_cast<char*>(arg.c_str()));
+            args.push_back(nullptr);
+            int error = posix_spawnp(&pid, args[0], &actions, &attr, args.data(), environ);
+            posix_spawn_file_actions_destroy(&actions);
+            posix_spawnattr_destroy(&attr);
+            close(outs[1]);
+            if (errs[1] >= 0) close(errs[1]);
+            if (ins[0] >= 0) close(ins[0]);
+            out_fd = outs[0];
+            err_fd = errs[0];
+            in_fd = ins[1];
+            if (error) {
+                pid = 0;
+                closeFd(out_fd);
+                closeFd(err_fd);
+                closeFd(in_fd);
+                result.error = concat(argv[0], ": ", strerror(error));
+                return;
+            }
+            fcntl(out_fd, F_SETFL, O_NONBLOCK);
+            out_buffer.resize(64 * 1024);
+            if (err_fd >= 0) fcntl(err_fd, F_SETFL, O_NONBLOCK);
+            if (in_fd >= 0) {
+                fcntl(in_fd, F_SETFL, O_NONBLOCK);
+                in_buffer.resize(64 * 1024);
+            }
+#ifdef SYS_pidfd_open
+            pid_fd = syscall(SYS_pidfd_open, pid, 0);
+#endif
+        }
+
+        virtual ~Process() {
+            if (pid) {
+                ::kill(-pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+            }
+            closeFd(out_fd);
+            closeFd(err_fd);
+            closeFd(pid_fd);
+            closeFd(in_fd);
+        }
+
+        Process(const Process&) = delete;
+        Process& operator=(const Process&) = delete;
+
+        // through /bin/sh -c (the command line can have pipes, redirections..)
+        static vector<string> shell(const string& command) {
+            return { "/bin/sh", "-c", command };
+        }
+
+        pid_t getPid() const {
+            return pid;
+        }
+
+        bool isRunning() const {
+            return pid;
+        }
+
+        // the signal to the process group, false when it's not running
+        bool kill(int signal = SIGKILL) {
+            return pid && !::kill(-pid, signal);
+        }
+
+        const ProcessResult& getResult() const {
+            return result;
+        }
+
+        // moves the result out (once it's finished)
+        ProcessResult takeResult() {
+            return move(result);
+        }
+
+        // reads the output of the processes (waits at most timeout ms, -1: no limit), handles the timeouts
+        // and reaps the finished ones, returns false when none is running
+        static bool poll(const vector<Process*>& processes, long timeout = -1) {
+            vector<pollfd> fds;
+            unsigned long long now = Clock().nanos();
+            bool running = false;
+            for (Process* process: processes) {
+                if (!process->pid) continue;
+                running = true;
+                if (process->out_fd >= 0) fds.push_back({ process->out_fd, POLLIN, 0 });
+                if (process->err_fd >= 0) fds.push_back({ process->err_fd, POLLIN, 0 });
+                if (process->in_fd >= 0) fds.push_back({ process->in_fd, POLLOUT, 0 });
+                long left = process->remaining(now);
+                if (left >= 0 && (timeout < 0 || left < timeout)) timeout = left;
+                // the output is closed but it did not exit yet: waits for the pidfd or checks it again in 1 ms
+                if (process->out_fd < 0 && process->err_fd < 0) {
+                    if (process->pid_fd >= 0) fds.push_back({ process->pid_fd, POLLIN, 0 });
+                    else if (timeout < 0 || timeout > 1) timeout = 1;
+                }
+            }
+            if (!running) return false;
+
+            if (::poll(fds.data(), fds.size(), timeout > INT_MAX ? INT_MAX : timeout) < 0 && errno != EINTR)
+                throw ERROR("poll() failed: ", strerror(errno)); // LCOV_EXCL_LINE
+            now = Clock().nanos();
+            size_t at = 0;
+            for (Process* process: processes) {
+                if (!process->pid) continue;
+                bool exiting = process->out_fd < 0 && process->err_fd < 0 && process->pid_fd >= 0;
+                ProcessResult& result = process->result;
+                const ProcessOptions& options = process->options;
+                if (process->out_fd >= 0 && fds[at++].revents) process->read(process->out_fd, result.out, options.on_out, process->out_line);
+                if (process->err_fd >= 0 && fds[at++].revents) process->read(process->err_fd, result.err, options.on_err, process->err_line);
+                if (process->in_fd >= 0 && fds[at++].revents) process->feed();
+                if (exiting) at++;
+                if (!process->remaining(now)) {
+                    process->result.timed_out = true;
+                    process->killed = true;
+                    process->kill(process->options.kill_signal);
+                }
+                process->reap();
+            }
+            return true;
+        }
+
+        // reads the output until it exits (or gets killed at the timeout)
+        const ProcessResult& wait() {
+            while (poll({ this }));
+            return result;
+        }
+
+        static ProcessResult run(const vector<string>& argv, const ProcessOptions& options = ProcessOptions()) {
+            Process process(argv, options);
+            process.wait();
+            return process.takeResult();
+        }
+    };
+
+    // runs the commands, at most concurrency (0: the number of cores) at once, in one thread,
+    // returns the results in the order of the commands (the callbacks of the options get the output of all)
+    inline vector<ProcessResult> exec_many(const vector<vector<string>>& commands, size_t concurrency = 0, const ProcessOptions& options = ProcessOptions()) {
+        if (!concurrency) concurrency = max(1u, thread::hardware_concurrency());
+        vector<ProcessResult> results(commands.size());
+        vector<pair<size_t, unique_ptr<Process>>> running;
+        size_t next = 0;
+        while (next < commands.size() || !running.empty()) {
+            while (running.size() < concurrency && next < commands.size()) {
+                running.emplace_back(next, make_unique<Process>(commands[next], options));
+                next++;
+            }
+            vector<Process*> processes;
+            for (auto& process: running) processes.push_back(process.second.get());
+            Process::poll(processes);
+            for (size_t i = 0; i < running.size(); i++) {
+                if (running[i].second->isRunning()) continue;
+                results[running[i].first] = running[i].second->takeResult();
+                running.erase(running.begin() + i--);
+            }
+        }
+        return results;
+    }
+
+    // streams the stdout of the command by lines (without the '\n'), the result has no out then
+    inline ProcessResult exec_lines(const vector<string>& argv, const ProcessOptions::Sink& on_line, ProcessOptions options = ProcessOptions()) {
+        options.on_out = on_line;
+        options.lines = true;
+        return Process::run(argv, options);
+    }
+
+    // runs the command on an other thread
+    inline future<ProcessResult> exec_async(const vector<string>& argv, const ProcessOptions& options = ProcessOptions()) {
+        return async(launch::async, [argv, options]() { return Process::run(argv, options); });
+    }
+
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <regex>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+
+using namespace std;
+
+namespace lib {
+
+    // Precompiled std::regex, the matching is const (thread-safe) and the captures can be views into
+    // the searched string. Regex::cached() shares the compiled patterns by a bounded LRU cache
+    // (reg_match() uses it), so a pattern used in a loop gets compiled only once.
+    class Regex {
+    public:
+        // the captures of one match, views into the searched string (empty for the unmatched groups)
+        class Match {
+        protected:
+            const cmatch* match;
+        public:
+            Match(const cmatch& match): match(&match) {}
+
+            size_t size() const {
+                return match->size();
+            }
+
+            string_view operator[](size_t group) const {
+                const csub_match& sub = (*match)[group];
+                return sub.matched ? string_view(sub.first, sub.length()) : string_view();
+            }
+
+            size_t position(size_t group = 0) const {
+                return match->position(group);
+            }
+        };
+
+        // iterates the (not overlapping) matches of a string
+        class Iterator {
+        protected:
+            cregex_iterator it;
+        public:
+            Iterator(cregex_iterator it = cregex_iterator()): it(it) {}
+
+            Match operator*() const {
+                return Match(*it);
+            }
+
+            Iterator& operator++() {
+                ++it;
+                return *this;
+            }
+
+            bool operator!=(const Iterator& other) const {
+                return it != other.it;
+            }
+        };
+
+        struct Range {
+            Iterator first;
+            Iterator last;
+
+            Iterator begin() const {
+                return first;
+            }
+
+            Iterator end() const {
+                return last;
+            }
+        };
+
+    protected:
+        string pattern;
+        regex compiled;
+
+        static inline mutex cache_lock;
+        static inline size_t cache_size = 64;
+        static inline list<shared_ptr<const Regex>> lru; // the most recently used first
+        static inline unordered_map<string, list<shared_ptr<const Regex>>::iterator> cache;
+
+    public:
+        // throws regex_error on an invalid pattern
+        explicit Regex(const string& pattern, regex::flag_type flags = regex::ECMAScript)
+            : pattern(pattern), compiled(pattern, flags) {}
+
+        const string& getPattern() const {
+            return pattern;
+        }
+
+        // searches the pattern in the string
+        bool match(string_view str) const {
+            return regex_search(str.data(), str.data() + str.size(), compiled);
+        }
+
+        // the captures (the whole match first) get into the vector (reused, not touched when not matching)
+        bool match(string_view str, vector<string_view>& captures) const {
+            cmatch m;
+            if (!regex_search(str.data(), str.data() + str.size(), m, compiled)) return false;
+            Match found(m);
+            captures.resize(found.size());
+            for (size_t i = 0; i < found.size(); i++) captures[i] = found[i];
+            return true;
+        }
+
+        bool match(string_view str, vector<string>* matches) const {
+            if (!matches) return match(str);
+            cmatch m;
+            if (!regex_search(str.data(), str.data() + str.size(), m, compiled)) return false;
+            matches->clear();
+            for (size_t i = 0; i < m.size(); i++) matches->push_back(m[i].str());
+            return true;
+        }
+
+        // all the matches: for (Regex::Match match: regex.all(str)) ... (the regex and the string must outlive the loop)
+        Range all(string_view str) const {
+            return { Iterator(cregex_iterator(str.data(), str.data() + str.size(), compiled)), Iterator() };
+        }
+
+        // the compiled pattern from the cache, compiles and caches it on a miss (evicts the least recently used)
+        static shared_ptr<const Regex> cached(const string& pattern) {
+            {
+                lock_guard<mutex> guard(cache_lock);
+                auto found = cache.find(pattern);
+                if (found != cache.end()) {
+                    lru.splice(lru.begin(), lru, found->second);
+                    return *found->second;
+                }
+            }
+            auto compiled = make_shared<const Regex>(pattern); // compiling out of the lock
+            lock_guard<mutex> guard(cache_lock);
+            auto found = cache.find(pattern);
+            if (found != cache.end()) return *found->second; // compiled by an other thread meanwhile
+            if (!cache_size) return compiled;
+            lru.push_front(compiled);
+            cache[pattern] = lru.begin();
+            while (lru.size() > cache_size) {
+                cache.erase(lru.back()->getPattern());
+                lru.pop_back();
+            }
+            return compiled;
+        }
+
+        // 0 disables the caching
+        static void setCacheSize(size_t size) {
+            lock_guard<mutex> guard(cache_lock);
+            cache_size = size;
+            while (lru.size() > cache_size) {
+                cache.erase(lru.back()->getPattern());
+                lru.pop_back();
+            }
+        }
+
+        static size_t getCacheSize() {
+            lock_guard<mutex> guard(cache_lock);
+            return cache_size;
+        }
+
+        static size_t getCacheCount() {
+            lock_guard<mutex> guard(cache_lock);
+            return lru.size();
+        }
+    };
+
+}
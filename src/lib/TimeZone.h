@@ -0,0 +1,331 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+
+using namespace std;
+
+namespace lib {
+
+    // days since 1970-01-01 of a proleptic Gregorian date (Howard Hinnant's algorithm)
+    inline constexpr long days_from_civil(long year, unsigned month, unsigned day) {
+        year -= month <= 2;
+        const long era = (year >= 0 ? year : year - 399) / 400;
+        const unsigned yoe = static_cast<unsigned>(year - era * 400);
+        const unsigned doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + static_cast<long>(doe) - 719468;
+    }
+
+    // days since 1970-01-01 to year/month/day, the inverse of days_from_civil()
+    inline constexpr void civil_from_days(long days, long& year, unsigned& month, unsigned& day) {
+        days += 719468;
+        const long era = (days >= 0 ? days : days - 146096) / 146097;
+        const unsigned doe = static_cast<unsigned>(days - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        day = doy - (153 * mp + 2) / 5 + 1;
+        month = mp < 10 ? mp + 3 : mp - 9;
+        year = static_cast<long>(yoe) + era * 400 + (month <= 2);
+    }
+
+    inline constexpr unsigned days_in_month(long year, unsigned month) {
+        return month == 2 ? (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0) ? 29 : 28) :
+            (month == 4 || month == 6 || month == 9 || month == 11 ? 30 : 31);
+    }
+
+    // Local time offsets of a zone loaded once from the TZif file (/etc/localtime, TZ or
+    // /usr/share/zoneinfo/<name>) with the POSIX TZ rule of its footer for the times after the
+    // last transition (or from a POSIX TZ string like "CET-1CEST,M3.5.0,M10.5.0/3").
+    // An instance is immutable, so the lookups need no locks. TimeZone::local() is the snapshot
+    // of the process' zone shared by datef() and date_parse(): it's loaded on the first use and
+    // replaced by reload() (call it after changing TZ, as tzset() for libc). The replaced
+    // snapshots are kept alive, the readers may still hold them (and reloads are rare).
+    class TimeZone {
+    protected:
+        struct Type {
+            long offset; // seconds east of UTC
+            bool dst;
+        };
+
+        // start or end of the DST in a POSIX TZ rule
+        struct Change {
+            char kind = 'M'; // 'J': Julian day 1..365 (no Feb 29), 'D': day 0..365, 'M': month.week.weekday
+            int day = 0;
+            int month = 0;
+            int week = 0;
+            long time = 7200; // seconds of the local time
+        };
+
+        struct Rule {
+            bool set = false;
+            long std_offset = 0;
+            long dst_offset = 0;
+            bool dst = false;
+            Change start;
+            Change end;
+        };
+
+        string name = "UTC";
+        vector<long> times; // transitions, UTC seconds
+        vector<unsigned char> indexes; // of the types, one per transition
+        vector<Type> types;
+        Rule rule;
+
+        static inline atomic<const TimeZone*> current = { nullptr };
+        static inline mutex reloading;
+        static inline vector<unique_ptr<const TimeZone>> snapshots;
+
+        static long floorDiv(long value, long divisor) {
+            return value >= 0 ? value / divisor : (value - divisor + 1) / divisor;
+        }
+
+        // local seconds of the change in the year
+        static long localTime(const Change& change, long year) {
+            long days = days_from_civil(year, 1, 1);
+            bool leap = days_in_month(year, 2) == 29;
+            if (change.kind == 'J') days += change.day - 1 + (leap && change.day >= 60);
+            else if (change.kind == 'D') days += change.day;
+            else {
+                long first = days_from_civil(year, change.month, 1);
+                long weekday = ((first + 4) % 7 + 7) % 7; // 1970-01-01 was Thursday
+                long day = 1 + (change.day - weekday + 7) % 7 + (change.week - 1) * 7;
+                while (day > days_in_month(year, change.month)) day -= 7;
+                days = first + day - 1;
+            }
+            return days * 86400 + change.time;
+        }
+
+        long ruleOffset(long sec) const {
+            if (!rule.dst) return rule.std_offset;
+            long year;
+            unsigned month, day;
+            civil_from_days(floorDiv(sec + rule.std_offset, 86400), year, month, day);
+            long start = localTime(rule.start, year) - rule.std_offset;
+            long end = localTime(rule.end, year) - rule.dst_offset;
+            bool dst = start < end ? sec >= start && sec < end : sec < end || sec >= start;
+            return dst ? rule.dst_offset : rule.std_offset;
+        }
+
+        static bool parseNumber(const char*& p, long& value) {
+            if (*p < '0' || *p > '9') return false;
+            for (value = 0; *p >= '0' && *p <= '9'; p++) value = value * 10 + (*p - '0');
+            return true;
+        }
+
+        // [+|-]hh[:mm[:ss]] in seconds
+        static bool parseTime(const char*& p, long& seconds) {
+            long sign = *p == '-' ? -1 : 1;
+            if (*p == '-' || *p == '+') p++;
+            long hours, minutes = 0, secs = 0;
+            if (!parseNumber(p, hours)) return false;
+            if (*p == ':' && !parseNumber(++p, minutes)) return false;
+            if (*p == ':' && !parseNumber(++p, secs)) return false;
+            seconds = sign * (hours * 3600 + minutes * 60 + secs);
+            return true;
+        }
+
+        static bool parseName(const char*& p) {
+            const char* start = p;
+            if (*p == '<') {
+                while (*p && *p != '>') p++;
+                if (*p != '>') return false;
+                return ++p - start > 2;
+            }
+            while ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')) p++;
+            return p - start >= 3;
+        }
+
+        static bool parseChange(const char*& p, Change& change) {
+            long value;
+            if (*p == 'M') {
+                long month, week, day;
+                if (!parseNumber(++p, month) || *p != '.' || !parseNumber(++p, week) || *p != '.' || !parseNumber(++p, day)) return false;
+                if (month < 1 || month > 12 || week < 1 || week > 5 || day > 6) return false;
+                change.kind = 'M';
+                change.month = month;
+                change.week = week;
+                change.day = day;
+            } else {
+                change.kind = *p == 'J' ? 'J' : 'D';
+                if (*p == 'J') p++;
+                if (!parseNumber(p, value) || value > 365 || (change.kind == 'J' && value < 1)) return false;
+                change.day = value;
+            }
+            change.time = 7200;
+            return *p != '/' || parseTime(++p, change.time);
+        }
+
+        // POSIX TZ string: std offset [dst [offset] [,start[/time],end[/time]]]
+        bool parseRule(const char* p) {
+            Rule parsed;
+            if (!parseName(p) || !parseTime(p, parsed.std_offset)) return false;
+            parsed.std_offset = -parsed.std_offset;
+            parsed.dst_offset = parsed.std_offset + 3600;
+            if (*p) {
+                if (!parseName(p)) return false;
+                parsed.dst = true;
+                if (*p && *p != ',') {
+                    if (!parseTime(p, parsed.dst_offset)) return false;
+                    parsed.dst_offset = -parsed.dst_offset;
+                }
+                if (*p == ',') {
+                    if (!parseChange(++p, parsed.start) || *p != ',' || !parseChange(++p, parsed.end)) return false;
+                } else {
+                    const char* us = "M3.2.0,M11.1.0"; // the US default
+                    parseChange(us, parsed.start);
+                    parseChange(++us, parsed.end);
+                }
+            }
+            if (*p) return false;
+            parsed.set = true;
+            rule = parsed;
+            return true;
+        }
+
+        static long readInt(const unsigned char* p, int bytes) {
+            uint64_t value = 0;
+            for (int i = 0; i < bytes; i++) value = value << 8 | p[i];
+            return bytes == 4 ? (long)(int32_t)(uint32_t)value : (long)(int64_t)value;
+        }
+
+        // RFC 8536, the 64-bit data of the version 2+ files
+        bool parseTZif(const string& data) {
+            const unsigned char* bytes = (const unsigned char*)data.data();
+            size_t size = data.size();
+            size_t at = 0;
+            int timesize = 4;
+            for (;;) {
+                if (size < at + 44 || data.compare(at, 4, "TZif")) return false;
+                size_t isutcnt = readInt(bytes + at + 20, 4), isstdcnt = readInt(bytes + at + 24, 4),
+                    leapcnt = readInt(bytes + at + 28, 4), timecnt = readInt(bytes + at + 32, 4),
+                    typecnt = readInt(bytes + at + 36, 4), charcnt = readInt(bytes + at + 40, 4);
+                size_t length = timecnt * timesize + timecnt + typecnt * 6 + charcnt +
+                    leapcnt * (timesize + 4) + isstdcnt + isutcnt;
+                if (!typecnt || size < at + 44 + length) return false;
+                if (data[4] >= '2' && timesize == 4) {
+                    at += 44 + length;
+                    timesize = 8;
+                    continue;
+                }
+
+                const unsigned char* p = bytes + at + 44;
+                times.resize(timecnt);
+                indexes.resize(timecnt);
+                types.resize(typecnt);
+                for (size_t i = 0; i < timecnt; i++, p += timesize) times[i] = readInt(p, timesize);
+                for (size_t i = 0; i < timecnt; i++, p++) {
+                    if (*p >= typecnt) return false;
+                    indexes[i] = *p;
+                }
+                for (size_t i = 0; i < typecnt; i++, p += 6) types[i] = { readInt(p, 4), p[4] != 0 };
+                at += 44 + length;
+                break;
+            }
+            // footer: \n<POSIX TZ string>\n
+            if (data[4] >= '2' && at < size && data[at] == '\n') {
+                size_t end = data.find('\n', at + 1);
+                if (end != string::npos && end > at + 1) parseRule(data.substr(at + 1, end - at - 1).c_str());
+            }
+            return true;
+        }
+
+    public:
+        // UTC
+        TimeZone() {}
+
+        // the zone as libc reads TZ: empty for /etc/localtime, a zoneinfo name or path (with an optional
+        // leading ':') or a POSIX TZ string, an unknown one is UTC (see load())
+        explicit TimeZone(const string& tz) {
+            load(tz);
+        }
+
+        // false when it's neither a readable TZif file nor a POSIX TZ string (then it stays UTC)
+        bool load(const string& tz) {
+            string spec = !tz.empty() && tz[0] == ':' ? tz.substr(1) : tz;
+            string path = spec.empty() ? "/etc/localtime" : spec;
+            if (path[0] != '/') {
+                const char* dir = getenv("TZDIR");
+                path = string(dir && *dir ? dir : "/usr/share/zoneinfo") + "/" + path;
+            }
+            name = spec.empty() ? "localtime" : spec;
+            ifstream file(path, ios::binary);
+            if (file) {
+                ostringstream content;
+                content << file.rdbuf();
+                if (parseTZif(content.str())) return true;
+            }
+            times.clear();
+            indexes.clear();
+            types.clear();
+            if (!spec.empty() && parseRule(spec.c_str())) return true;
+            name = "UTC";
+            rule = Rule();
+            return spec.empty() || spec == "UTC";
+        }
+
+        const string& getName() const {
+            return name;
+        }
+
+        // offset of the local time to UTC (seconds east) at the UTC time (seconds)
+        long offset(long sec) const {
+            if (rule.set && (times.empty() || sec >= times.back())) return ruleOffset(sec);
+            if (types.empty()) return 0;
+            size_t index = upper_bound(times.begin(), times.end(), sec) - times.begin();
+            return types[index ? indexes[index - 1] : 0].offset;
+        }
+
+        bool isDst(long sec) const {
+            if (rule.set && (times.empty() || sec >= times.back())) return rule.dst && ruleOffset(sec) == rule.dst_offset;
+            if (types.empty()) return false;
+            size_t index = upper_bound(times.begin(), times.end(), sec) - times.begin();
+            return types[index ? indexes[index - 1] : 0].dst;
+        }
+
+        // offset of a local time (seconds as if it was UTC), as mktime() with tm_isdst = -1 does:
+        // the later one of a repeated hour, the one before the change in a skipped hour
+        long localOffset(long local) const {
+            long first = offset(local);
+            long second = offset(local - first);
+            if (second == first) return first;
+            long third = offset(local - second);
+            if (third == second) return second;
+            return offset(min(local - first, local - second));
+        }
+
+        long toLocal(long sec) const {
+            return sec + offset(sec);
+        }
+
+        long fromLocal(long local) const {
+            return local - localOffset(local);
+        }
+
+        // the shared snapshot of the process' zone (TZ or /etc/localtime), lock-free after the first load
+        static const TimeZone& local() {
+            const TimeZone* zone = current.load(memory_order_acquire);
+            return zone ? *zone : reload();
+        }
+
+        // reloads the process' zone, the next local() calls see the new snapshot
+        static const TimeZone& reload() {
+            const char* tz = getenv("TZ");
+            auto zone = make_unique<TimeZone>(!tz ? "" : *tz ? tz : "UTC"); // an empty TZ is UTC for libc
+            lock_guard<mutex> guard(reloading);
+            snapshots.push_back(move(zone));
+            current.store(snapshots.back().get(), memory_order_release);
+            return *snapshots.back();
+        }
+    };
+
+}
@@ -6,16 +6,18 @@
 
 namespace lib {
 
+    // Runs on the nanosecond clock (see Clock::nanos()), 
+    // the intervals can be given in milliseconds or in nanoseconds.
     class Timer {
     private:
         Clock &clock;
-        unsigned long ms;
+        unsigned long long ns;
         bool force;
-        unsigned long next;
+        unsigned long long next;
 
     public:
         Timer(Clock &clock, unsigned long ms = TIMER_OFF, bool force = true)
-            : clock(clock), ms(ms), force(force), next(clock.now()) {}
+            : clock(clock), ns(ms * CLK_NS_PER_MS), force(force), next(clock.nanos()) {}
 
         virtual ~Timer() {}
 
@@ -25,22 +27,26 @@ namespace lib {
 
         bool check() {
             if (clock.now() == CLK_NULL) return false;
-            if (ms == TIMER_OFF) return false;
-            unsigned long now = clock.now();
+            if (ns == TIMER_OFF) return false;
+            unsigned long long now = clock.nanos();
             if (next <= now)
             {
                 if (force)
-                    next += ms;
+                    next += ns;
                 else
-                    next = now + ms;
+                    next = now + ns;
                 return true;
             }
             return false;
         }
 
         void setInterval(unsigned long ms = TIMER_OFF) {
+            setIntervalNanos(ms * CLK_NS_PER_MS);
+        }
+
+        void setIntervalNanos(unsigned long long ns = TIMER_OFF) {
             if (clock.now() == CLK_NULL) return;
-            this->ms = ms;
+            this->ns = ns;
         }
 
         void off() {
@@ -49,7 +55,11 @@ namespace lib {
 
         
         unsigned long getInterval() const {
-            return ms;
+            return ns / CLK_NS_PER_MS;
+        }
+
+        unsigned long long getIntervalNanos() const {
+            return ns;
         }
 
         void setForce(bool force) {
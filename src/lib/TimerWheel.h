@@ -0,0 +1,238 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include "Clock.h"
+#include "Timer.h"
+
+using namespace std;
+
+namespace lib {
+
+    // Hierarchical timer wheel of callbacks, 4 levels x 256 slots of tick_ms
+    // (49 days at 1 ms, the later ones wait in the last level and get cascaded again).
+    // schedule() and cancel() are O(1), one advance() per tick fires the callbacks due
+    // on the clock, so it's deterministic with a fake Clock. A repeating timer gets
+    // rescheduled as Timer::check() does: with force it fires once for each missed
+    // interval (catch-up), otherwise the next one is an interval after now.
+    // Not thread-safe, the callbacks run in advance() and may schedule or cancel timers (but must not throw).
+    class TimerWheel {
+    public:
+        typedef unsigned long long Id;
+
+    protected:
+        static constexpr unsigned BITS = 8;
+        static constexpr unsigned SLOTS = 1u << BITS;
+        static constexpr unsigned LEVELS = 4;
+        static constexpr unsigned NIL = -1u;
+        static constexpr unsigned RUNNING = LEVELS * SLOTS; // list of the callbacks to fire in this tick
+        static constexpr unsigned FIRING = RUNNING + 1; // the callback is running (not in a list)
+
+        struct Entry {
+            function<void()> callback;
+            unsigned long long due; // ms
+            unsigned long interval; // ms, TIMER_OFF for one-shot
+            bool force;
+            unsigned generation = 0;
+            unsigned list = NIL; // NIL when it's free
+            unsigned prev = NIL;
+            unsigned next = NIL;
+        };
+
+        Clock& clock;
+        unsigned long tick_ms;
+        unsigned long long tick; // the next tick to process
+        bool advancing = false;
+        deque<Entry> entries; // stable references, the callbacks can schedule
+        vector<unsigned> freed;
+        vector<unsigned> heads = vector<unsigned>(RUNNING + 1, NIL);
+        vector<unsigned> tails = vector<unsigned>(RUNNING + 1, NIL);
+        size_t counts[LEVELS] = {};
+        size_t count = 0;
+
+        void link(unsigned index, unsigned list) {
+            Entry& entry = entries[index];
+            entry.list = list;
+            entry.prev = tails[list];
+            entry.next = NIL;
+            if (tails[list] == NIL) heads[list] = index;
+            else entries[tails[list]].next = index;
+            tails[list] = index;
+            if (list < RUNNING) counts[list / SLOTS]++;
+        }
+
+        void unlink(unsigned index) {
+            Entry& entry = entries[index];
+            if (entry.prev == NIL) heads[entry.list] = entry.next;
+            else entries[entry.prev].next = entry.next;
+            if (entry.next == NIL) tails[entry.list] = entry.prev;
+            else entries[entry.next].prev = entry.prev;
+            if (entry.list < RUNNING) counts[entry.list / SLOTS]--;
+            entry.list = NIL;
+        }
+
+        void release(unsigned index) {
+            Entry& entry = entries[index];
+            entry.callback = nullptr;
+            entry.generation++;
+            entry.list = NIL;
+            freed.push_back(index);
+            count--;
+        }
+
+        // into the slot of the due tick, at the level by the distance from the current tick
+        void insert(unsigned index) {
+            unsigned long long due = (entries[index].due + tick_ms - 1) / tick_ms;
+            if (due <= tick) {
+                if (advancing) link(index, RUNNING);
+                else link(index, tick & (SLOTS - 1));
+                return;
+            }
+            unsigned long long delta = due - tick;
+            if (delta >= 1ull << (BITS * LEVELS)) {
+                delta = (1ull << (BITS * LEVELS)) - 1;
+                due = tick + delta;
+            }
+            unsigned level = 0;
+            while (delta >= 1ull << (BITS * (level + 1))) level++;
+            link(index, level * SLOTS + ((due >> (BITS * level)) & (SLOTS - 1)));
+        }
+
+        // moves the timers of the level's current slot to the lower levels
+        void cascade(unsigned level) {
+            unsigned list = level * SLOTS + ((tick >> (BITS * level)) & (SLOTS - 1));
+            while (heads[list] != NIL) {
+                unsigned index = heads[list];
+                unlink(index);
+                insert(index);
+            }
+        }
+
+        // fires the running list, the catch-ups of the forced timers get appended to it
+        size_t fire(unsigned long now) {
+            size_t fired = 0;
+            while (heads[RUNNING] != NIL) {
+                unsigned index = heads[RUNNING];
+                unlink(index);
+                entries[index].list = FIRING;
+                entries[index].callback();
+                fired++;
+                Entry& entry = entries[index];
+                if (entry.interval == TIMER_OFF) {
+                    release(index);
+                    continue;
+                }
+                entry.list = NIL;
+                if (entry.force) entry.due += entry.interval;
+                else entry.due = now + entry.interval;
+                insert(index);
+            }
+            return fired;
+        }
+
+    public:
+        TimerWheel(Clock& clock, unsigned long tick_ms = 1)
+            : clock(clock), tick_ms(tick_ms ? tick_ms : 1), tick(clock.now() / this->tick_ms) {}
+
+        Clock& getClock() const {
+            return clock;
+        }
+
+        // fires the callback ms later, then every ms when it repeats (ms = 0 fires on the next tick)
+        Id schedule(unsigned long ms, function<void()> callback, bool repeat = false, bool force = true) {
+            unsigned index;
+            if (freed.empty()) {
+                index = entries.size();
+                entries.emplace_back();
+            } else {
+                index = freed.back();
+                freed.pop_back();
+            }
+            Entry& entry = entries[index];
+            entry.callback = move(callback);
+            entry.due = clock.now() + ms;
+            entry.interval = repeat ? ms : TIMER_OFF;
+            entry.force = force;
+            count++;
+            insert(index);
+            return ((Id)entry.generation << 32) | index;
+        }
+
+        bool cancel(Id id) {
+            if (!isScheduled(id)) return false;
+            unsigned index = id & 0xffffffffu;
+            Entry& entry = entries[index];
+            if (entry.list == FIRING) {
+                entry.interval = TIMER_OFF; // released after its callback returns
+                return true;
+            }
+            unlink(index);
+            release(index);
+            return true;
+        }
+
+        bool isScheduled(Id id) const {
+            unsigned index = id & 0xffffffffu;
+            return index < entries.size() && entries[index].generation == (id >> 32) &&
+                entries[index].list != NIL && !(entries[index].list == FIRING && entries[index].interval == TIMER_OFF);
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        // the time (ms) of the next advance() with something to do, exact for the timers
+        // due in 256 ticks, the time of the next cascade for the later ones, CLK_NULL when it's empty
+        unsigned long nextDue() const {
+            if (heads[RUNNING] != NIL) return tick * tick_ms;
+            unsigned long long next = -1ull;
+            for (unsigned level = 0; level < LEVELS; level++) {
+                if (!counts[level]) continue;
+                unsigned long long base = tick >> (BITS * level);
+                // the current slot of a higher level is for the next round once it was cascaded
+                bool cascaded = level && (tick & ((1ull << (BITS * level)) - 1));
+                for (unsigned long long offset = cascaded ? 1 : 0; offset <= SLOTS; offset++) {
+                    if (heads[level * SLOTS + ((base + offset) & (SLOTS - 1))] == NIL) continue;
+                    next = min(next, (base + offset) << (BITS * level));
+                    break;
+                }
+            }
+            return next == -1ull ? CLK_NULL : max(next, tick) * tick_ms;
+        }
+
+        // processes the ticks up to the clock, skipping the empty ones, returns the number of the fired callbacks
+        size_t advance() {
+            unsigned long now = clock.now();
+            if (now == CLK_NULL) return 0;
+            unsigned long long target = now / tick_ms;
+            size_t fired = 0;
+            advancing = true;
+            while (tick <= target) {
+                for (unsigned level = 1; level < LEVELS && !(tick & ((1ull << (BITS * level)) - 1)); level++)
+                    cascade(level);
+
+                unsigned slot = tick & (SLOTS - 1);
+                while (heads[slot] != NIL) {
+                    unsigned index = heads[slot];
+                    unlink(index);
+                    link(index, RUNNING);
+                }
+                fired += fire(now);
+                tick++;
+
+                // the lower levels are empty: jump to the next cascade of the lowest non-empty level
+                unsigned level = 0;
+                while (level < LEVELS && !counts[level]) level++;
+                if (level == LEVELS) tick = target + 1;
+                else if (level) {
+                    unsigned long long span = 1ull << (BITS * level);
+                    tick = min((tick + span - 1) / span * span, target + 1);
+                }
+            }
+            advancing = false;
+            return fired;
+        }
+    };
+
+}
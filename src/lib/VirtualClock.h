@@ -0,0 +1,156 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include "Clock.h"
+
+using namespace std;
+
+namespace lib {
+
+    // Thread-safe fake clock: delay() blocks the thread until the virtual time reaches its wakeup.
+    // The time jumps straight to the earliest wakeup, either automatically when all the participant threads
+    // are blocked in delay() or, when it's not automatic, by a controller thread (advance(), advanceTo()),
+    // so the simulated minutes pass in microseconds in the same order every run.
+    // The participants are given at construction or join by a VirtualClock::Thread guard.
+    // The threads waking at the same instant resume one by one in the order they called delay(),
+    // the next one when the previous blocked again or left.
+    class VirtualClock: public Clock {
+    protected:
+        mutable mutex lock;
+        condition_variable changed;
+        std::set<pair<unsigned long long, unsigned long long>> wakeups; // ns and sequence number of the blocked delays
+        unsigned long long sequence = 0;
+        size_t participants;
+        bool automatic;
+        size_t blocked = 0;
+
+        // under the lock ...
+
+        unsigned long long time() const {
+            return ts * CLK_NS_PER_MS + ts_ns;
+        }
+
+        void moveTo(unsigned long long ns) {
+            ts = ns / CLK_NS_PER_MS;
+            ts_ns = ns % CLK_NS_PER_MS;
+            changed.notify_all();
+        }
+
+        // all the woken threads are blocked again (or gone)
+        bool settled() const {
+            return (wakeups.empty() || wakeups.begin()->first > time()) && blocked >= participants;
+        }
+
+        void autoAdvance() {
+            if (automatic && participants && settled() && !wakeups.empty()) moveTo(wakeups.begin()->first);
+        }
+
+    public:
+        // joins the clock for the lifetime of the guard, put it at the start of the participant threads
+        class Thread {
+        protected:
+            VirtualClock& clock;
+        public:
+            Thread(VirtualClock& clock): clock(clock) {
+                clock.join();
+            }
+
+            ~Thread() {
+                clock.leave();
+            }
+        };
+
+        // participants = 1 on a single thread works as the fake Clock does
+        VirtualClock(unsigned long ts = 1, size_t participants = 0, bool automatic = true)
+            : Clock(ts), participants(participants), automatic(automatic) {
+            if (ts == CLK_REAL) throw ERROR("Virtual clock can not start at real time");
+        }
+
+        unsigned long now() const override {
+            lock_guard<mutex> guard(lock);
+            return ts;
+        }
+
+        unsigned long long nanos() const override {
+            lock_guard<mutex> guard(lock);
+            return time();
+        }
+
+        bool isReal() const override {
+            return false;
+        }
+
+        void delay(unsigned long ms) override {
+            delayNanos(ms * CLK_NS_PER_MS);
+        }
+
+        void delayNanos(unsigned long long ns) override {
+            unique_lock<mutex> guard(lock);
+            unsigned long long wakeup = time() + ns;
+            auto at = wakeups.insert({ wakeup, sequence++ }).first;
+            blocked++;
+            changed.notify_all();
+            autoAdvance();
+            // the first due one when all the participants are blocked (the one woken before is blocked again)
+            changed.wait(guard, [&]() { return time() >= wakeup && wakeups.begin() == at && blocked >= participants; });
+            wakeups.erase(at);
+            blocked--;
+            changed.notify_all();
+        }
+
+        void set(unsigned long ms) override {
+            setNanos(ms * CLK_NS_PER_MS);
+        }
+
+        void setNanos(unsigned long long ns) override {
+            lock_guard<mutex> guard(lock);
+            moveTo(ns);
+        }
+
+        void join() {
+            lock_guard<mutex> guard(lock);
+            participants++;
+        }
+
+        void leave() {
+            lock_guard<mutex> guard(lock);
+            participants--;
+            changed.notify_all();
+            autoAdvance();
+        }
+
+        // waits until (at least) the number of threads are blocked in delay()
+        void waitBlocked(size_t threads) {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&]() { return blocked >= threads; });
+        }
+
+        // jumps to the earliest wakeup, false when no thread is waiting
+        bool advance() {
+            lock_guard<mutex> guard(lock);
+            if (wakeups.empty()) return false;
+            if (wakeups.begin()->first > time()) moveTo(wakeups.begin()->first);
+            return true;
+        }
+
+        // steps through the wakeups up to the time (ms), lets the woken participants block again
+        // (or leave) after each step, then the time is set to the target
+        void advanceTo(unsigned long ms) {
+            unique_lock<mutex> guard(lock);
+            unsigned long long target = ms * CLK_NS_PER_MS;
+            for (;;) {
+                changed.wait(guard, [&]() { return settled(); });
+                if (wakeups.empty() || wakeups.begin()->first > target) break;
+                moveTo(wakeups.begin()->first);
+            }
+            if (target > time()) moveTo(target);
+        }
+
+        void advanceBy(unsigned long ms) {
+            advanceTo(now() + ms);
+        }
+    };
+
+}
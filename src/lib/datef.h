@@ -1,44 +1,217 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <cstring>
 #include "Clock.h"
 
 using namespace std;
 
 namespace lib {
 
-	inline string datef(long ms = 0, const char* fmt = "%Y-%m-%d %H:%M:%S", bool millis = true, bool local = false) {
-		if (!ms) {
-		    Clock clock;
-		    ms = clock.now();
+	// Precompiled strftime-like format: the format is parsed once into ops (compile() is constexpr, so
+	// a literal format can be compiled at compile time; the instances compile theirs at run time once),
+	// the dates are computed by civil_from_days() (no gmtime_r/localtime_r, the local offset is by
+	// TimeZone::local()) and the formatted prefix of the last second is cached, so within the same
+	// second only the milliseconds get written.
+	// Supported: %Y %y %m %d %e %H %M %S %j %F %T %%, any other directive falls back to strftime()
+	// (once per second). One instance is not thread-safe (see datef() for thread_local ones).
+	class DateFormat {
+	public:
+		static constexpr size_t MAX_OPS = 32;
+
+		struct Op {
+			char type = 0; // the directive or 0 for a literal
+			unsigned short at = 0; // literal in the format
+			unsigned short len = 0;
+		};
+
+		struct Ops {
+			Op ops[MAX_OPS] = {};
+			size_t count = 0;
+			bool strftime = false; // not supported directive or too long format
+		};
+
+		static constexpr Ops compile(const char* fmt) {
+			Ops ops;
+			size_t i = 0;
+			while (fmt[i]) {
+				if (ops.count == MAX_OPS || i > 0xffff) {
+					ops.strftime = true;
+					return ops;
+				}
+				Op& op = ops.ops[ops.count++];
+				if (fmt[i] != '%' || fmt[i + 1] == '%') {
+					// literal up to the next directive, %% is a literal %
+					op.at = fmt[i] == '%' ? i + 1 : i;
+					i += fmt[i] == '%' ? 2 : 1;
+					while (fmt[i] && fmt[i] != '%') i++;
+					op.len = i - op.at;
+					continue;
+				}
+				switch (fmt[i + 1]) {
+					case 'Y': case 'y': case 'm': case 'd': case 'e': case 'H':
+					case 'M': case 'S': case 'j': case 'F': case 'T':
+						op.type = fmt[i + 1];
+						i += 2;
+						break;
+					default:
+						ops.strftime = true;
+						return ops;
+				}
+			}
+			return ops;
+		}
+
+	protected:
+		string pattern;
+		bool millis;
+		bool local;
+		Ops ops;
+		long second = 0;
+		bool cached = false;
+		const TimeZone* zone = nullptr; // the snapshot of the cached local date
+		string prefix; // the formatted second
+
+		static char* digits(char* out, unsigned long value, int width, char pad = '0') {
+			char* end = out + width;
+			char* p = end;
+			do {
+				*--p = '0' + value % 10;
+				value /= 10;
+			} while (value && p > out);
+			while (p > out) *--p = pad;
+			return end;
+		}
+
+		void render(long sec) {
+			long wall = local ? zone->toLocal(sec) : sec;
+			// the 4 digit years only, strftime() knows the rest
+			if (ops.strftime || wall < -30610224000L || wall >= 253402300800L) {
+				struct tm tm = {};
+				time_t time = sec;
+				if (local) localtime_r(&time, &tm);
+				else gmtime_r(&time, &tm);
+				prefix.resize(max(prefix.capacity(), pattern.size() * 4 + 32));
+				size_t len;
+				while (!(len = strftime(&prefix[0], prefix.size(), pattern.c_str(), &tm)) && !pattern.empty() && prefix.size() < 4096)
+					prefix.resize(prefix.size() * 2);
+				prefix.resize(len);
+				return;
+			}
+
+			long year;
+			unsigned month, day;
+			long days = wall >= 0 ? wall / 86400 : (wall - 86399) / 86400;
+			long rest = wall - days * 86400;
+			civil_from_days(days, year, month, day);
+			unsigned hour = rest / 3600;
+			unsigned minute = rest / 60 % 60;
+			unsigned seconds = rest % 60;
+			unsigned yday = days - days_from_civil(year, 1, 1);
+
+			char buff[32];
+			prefix.clear();
+			for (size_t i = 0; i < ops.count; i++) {
+				const Op& op = ops.ops[i];
+				char* p = buff;
+				switch (op.type) {
+					case 0: prefix.append(pattern, op.at, op.len); continue;
+					case 'Y': p = digits(p, year, 4); break;
+					case 'y': p = digits(p, year % 100, 2); break;
+					case 'm': p = digits(p, month, 2); break;
+					case 'd': p = digits(p, day, 2); break;
+					case 'e': p = digits(p, day, 2, ' '); break;
+					case 'H': p = digits(p, hour, 2); break;
+					case 'M': p = digits(p, minute, 2); break;
+					case 'S': p = digits(p, seconds, 2); break;
+					case 'j': p = digits(p, yday + 1, 3); break;
+					case 'F':
+						p = digits(p, year, 4);
+						*p++ = '-'; p = digits(p, month, 2); *p++ = '-'; p = digits(p, day, 2);
+						break;
+					case 'T':
+						p = digits(p, hour, 2); *p++ = ':'; p = digits(p, minute, 2); *p++ = ':'; p = digits(p, seconds, 2);
+						break;
+				}
+				prefix.append(buff, p - buff);
+			}
 		}
-		
-		long sec = ms / 1000;
-		long mil = ms % 1000;
 
-		struct tm converted_time;
-		if (local)
-		{
-		    localtime_r(&sec, &converted_time);
+	public:
+		DateFormat(const char* fmt = "%Y-%m-%d %H:%M:%S", bool millis = true, bool local = false)
+			: pattern(fmt), millis(millis), local(local), ops(compile(pattern.c_str())) {}
+
+		// the same format (for reusing a cached instance)
+		bool is(const char* fmt, bool millis, bool local) const {
+			return this->millis == millis && this->local == local && pattern == fmt;
 		}
-		else
-		{
-		    gmtime_r(&sec, &converted_time);
+
+		// writes the date into the buffer (terminated, truncated to size - 1),
+		// returns the length of the whole date as snprintf() does
+		size_t format(long ms, char* buff, size_t size) {
+			long sec = ms >= 0 ? ms / 1000 : (ms - 999) / 1000;
+			const TimeZone* current = local ? &TimeZone::local() : nullptr;
+			if (!cached || sec != second || current != zone) {
+				zone = current;
+				render(sec);
+				second = sec;
+				cached = true;
+			}
+			size_t len = prefix.size() + (millis ? 4 : 0);
+			if (!size) return len;
+			size_t n = min(prefix.size(), size - 1);
+			memcpy(buff, prefix.data(), n);
+			if (millis) {
+				char mil[4] = { '.' };
+				digits(mil + 1, ms - sec * 1000, 3);
+				size_t m = min((size_t)4, size - 1 - n);
+				memcpy(buff + n, mil, m);
+				n += m;
+			}
+			buff[n] = 0;
+			return len;
 		}
 
-		char time_sbuff[26];
-		strftime(time_sbuff, 26, fmt, &converted_time);
+		string format(long ms) {
+			char buff[64];
+			size_t len = format(ms, buff, sizeof(buff));
+			if (len < sizeof(buff)) return string(buff, len);
+			string out(len, 0);
+			format(ms, &out[0], len + 1);
+			return out;
+		}
 
-		if (millis) {
-		    char mil_sbuff[10];
-		    sprintf(mil_sbuff, "%03ld", mil);
+		// formats a column of timestamps into fixed width records of the output (stride bytes each,
+		// terminated, truncated), returns the longest length
+		size_t format(const long* ms, size_t count, char* out, size_t stride) {
+			size_t longest = 0;
+			for (size_t i = 0; i < count; i++) longest = max(longest, format(ms[i], out + i * stride, stride));
+			return longest;
+		}
 
-		    char out_sbuff[42];
-		    sprintf(out_sbuff, "%s.%s", time_sbuff, mil_sbuff);
-		    return string(out_sbuff);
+		vector<string> format(const vector<long>& ms) {
+			vector<string> dates;
+			dates.reserve(ms.size());
+			for (long m: ms) dates.push_back(format(m));
+			return dates;
 		}
+	};
 
-		return string(time_sbuff);
+	inline string datef(long ms = 0, const char* fmt = "%Y-%m-%d %H:%M:%S", bool millis = true, bool local = false) {
+		if (!ms) {
+		    Clock clock;
+		    ms = clock.now();
+		}
+		// a few formats per thread, so the interleaved ones (e.g. log lines and file names) keep theirs
+		static const size_t slots = 4;
+		thread_local DateFormat cached[slots];
+		thread_local size_t next = 0;
+		for (size_t i = 0; i < slots; i++)
+			if (cached[i].is(fmt, millis, local)) return cached[i].format(ms);
+		DateFormat& slot = cached[next++ % slots];
+		slot = DateFormat(fmt, millis, local);
+		return slot.format(ms);
 	}
 
 	inline string datefYMD(long ms = 0, bool local = false) {
@@ -46,4 +219,3 @@ namespace lib {
 	}
 
 }
-
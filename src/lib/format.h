@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <ostream>
+#include <charconv>
+#include <cstring>
+#include <type_traits>
+
+using namespace std;
+
+namespace lib {
+
+    // Formatting core of join(), concat() and the ERROR/PRINT/DBG macros: appends the values
+    // as ostream's << does with the default flags, without a stream. The numbers are written by
+    // to_chars() into a stack buffer (the floating points as %g with precision 6, bool as 1/0),
+    // the strings and chars as they are, anything else falls back to its operator<<.
+    // The output is reserved by the estimated size up front, so it's one allocation at most.
+
+    // the estimated length of a value
+    template <typename T>
+    inline size_t str_size(const T& value) {
+        typedef decay_t<T> D;
+        if constexpr (is_array_v<T> && is_same_v<remove_cv_t<remove_extent_t<T>>, char>) return strlen(value);
+        else if constexpr (is_same_v<D, char*> || is_same_v<D, const char*>) return value ? strlen(value) : 0;
+        else if constexpr (is_convertible_v<const T&, string_view>) return string_view(value).size();
+        else if constexpr (is_same_v<D, char> || is_same_v<D, bool>) return 1;
+        else if constexpr (is_integral_v<D>) return 20;
+        else return 16;
+    }
+
+    template <typename T>
+    inline void str_append_one(string& out, const T& value) {
+        typedef decay_t<T> D;
+        if constexpr (is_array_v<T> && is_same_v<remove_cv_t<remove_extent_t<T>>, char>) {
+            out.append(value);
+        } else if constexpr (is_same_v<D, char*> || is_same_v<D, const char*>) {
+            if (value) out.append(value);
+        } else if constexpr (is_convertible_v<const T&, string_view>) {
+            out.append(string_view(value));
+        } else if constexpr (is_same_v<D, char> || is_same_v<D, signed char> || is_same_v<D, unsigned char>) {
+            out.push_back((char)value);
+        } else if constexpr (is_same_v<D, bool>) {
+            out.push_back(value ? '1' : '0');
+        } else if constexpr (is_integral_v<D>) {
+            char buff[24];
+            out.append(buff, to_chars(buff, buff + sizeof(buff), value).ptr);
+        } else if constexpr (is_floating_point_v<D>) {
+            char buff[64];
+            out.append(buff, to_chars(buff, buff + sizeof(buff), value, chars_format::general, 6).ptr);
+        } else {
+            ostringstream oss;
+            oss << value;
+            out.append(oss.str());
+        }
+    }
+
+    // appends the values to the string
+    template <typename... T>
+    inline string& str_append(string& out, const T&... args) {
+        out.reserve(out.size() + (str_size(args) + ... + 0));
+        (str_append_one(out, args), ...);
+        return out;
+    }
+
+    // appends the values with the glue between them
+    template <typename... T>
+    inline string& str_append_join(string& out, string_view glue, const T&... args) {
+        out.reserve(out.size() + (str_size(args) + ... + 0) + glue.size() * sizeof...(args));
+        bool first = true;
+        ((first ? (void)(first = false) : (void)out.append(glue), str_append_one(out, args)), ...);
+        return out;
+    }
+
+    // the reusable thread-local buffer of str_sink()
+    struct StrBuffer {
+        string buffer;
+        bool busy = false; // a local string is used when an argument's operator<< writes too
+    };
+
+    inline StrBuffer& str_thread_buffer() {
+        static thread_local StrBuffer buffer;
+        return buffer;
+    }
+
+    // formats the values into the thread-local buffer and passes it to the sink as a string_view
+    // (so only the sink can copy), e.g. str_sink([&](string_view str) { write(fd, str.data(), str.size()); }, ...)
+    template <typename Sink, typename... T>
+    inline void str_sink(Sink&& sink, const T&... args) {
+        StrBuffer& buffer = str_thread_buffer();
+        if (buffer.busy) {
+            string local;
+            sink(string_view(str_append(local, args...)));
+            return;
+        }
+        buffer.busy = true;
+        buffer.buffer.clear();
+        try {
+            str_append(buffer.buffer, args...);
+            sink(string_view(buffer.buffer));
+        } catch (...) {
+            buffer.busy = false;
+            throw;
+        }
+        buffer.busy = false;
+    }
+
+    // writes the values to the stream in one write()
+    template <typename... T>
+    inline ostream& str_write(ostream& out, const T&... args) {
+        str_sink([&](string_view str) { out.write(str.data(), str.size()); }, args...);
+        return out;
+    }
+
+}
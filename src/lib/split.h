@@ -0,0 +1,150 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstring>
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SPLIT_SIMD
+#endif
+
+using namespace std;
+
+namespace lib {
+
+    // what to do with the empty tokens
+    enum split_policy {
+        SPLIT_KEEP_EMPTY, // "a,,b," -> "a", "", "b", "" ("" -> "")
+        SPLIT_DROP_TRAILING, // the last one only if it's empty, as getline() does: "a,,b," -> "a", "", "b" ("" -> none)
+        SPLIT_SKIP_EMPTY, // "a,,b," -> "a", "b"
+    };
+
+#ifdef SPLIT_SIMD
+    inline const char* split_find_sse2(const char* p, const char* end, char c) {
+        const __m128i needle = _mm_set1_epi8(c);
+        for (; end - p >= 16; p += 16) {
+            unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), needle));
+            if (mask) return p + __builtin_ctz(mask);
+        }
+        while (p < end && *p != c) p++;
+        return p;
+    }
+
+    __attribute__((target("avx2"))) inline const char* split_find_avx2(const char* p, const char* end, char c) {
+        const __m256i needle = _mm256_set1_epi8(c);
+        for (; end - p >= 32; p += 32) {
+            unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), needle));
+            if (mask) return p + __builtin_ctz(mask);
+        }
+        return split_find_sse2(p, end, c);
+    }
+#endif
+
+    // the first c in [p, end) or end: 32 bytes at once by AVX2 (when the CPU has it) or 16 by SSE2
+    // on x86, memchr() elsewhere
+    inline const char* split_find(const char* p, const char* end, char c) {
+#ifdef SPLIT_SIMD
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2 ? split_find_avx2(p, end, c) : split_find_sse2(p, end, c);
+#else
+        const void* found = memchr(p, c, end - p);
+        return found ? (const char*)found : end;
+#endif
+    }
+
+    // the first delimiter in [p, end) or end
+    inline const char* split_find(const char* p, const char* end, string_view delimiter) {
+        if (delimiter.size() == 1) return split_find(p, end, delimiter[0]);
+        if (delimiter.empty() || (size_t)(end - p) < delimiter.size()) return end;
+        const char* last = end - delimiter.size() + 1; // the last possible start + 1
+        while ((p = split_find(p, last, delimiter[0])) < last) {
+            if (!memcmp(p + 1, delimiter.data() + 1, delimiter.size() - 1)) return p;
+            p++;
+        }
+        return end;
+    }
+
+    // Lazy split of a string into string_view tokens (no copies, no allocations):
+    // for (string_view token: split(line, ",")) ...
+    // The delimiter can be more characters, an empty one does not split. The string must outlive the tokens.
+    class Splitter {
+    protected:
+        string_view str;
+        string_view delimiter;
+        split_policy policy;
+
+    public:
+        class Iterator {
+        protected:
+            const Splitter* splitter = nullptr; // nullptr at the end
+            const char* rest = nullptr; // nullptr after the last token
+            string_view token;
+
+            void next() {
+                const char* end = splitter->str.data() + splitter->str.size();
+                for (;;) {
+                    if (!rest) {
+                        splitter = nullptr;
+                        return;
+                    }
+                    const char* found = split_find(rest, end, splitter->delimiter);
+                    token = string_view(rest, found - rest);
+                    rest = found == end ? nullptr : found + splitter->delimiter.size();
+                    if (token.empty() && (splitter->policy == SPLIT_SKIP_EMPTY || (splitter->policy == SPLIT_DROP_TRAILING && !rest))) continue;
+                    return;
+                }
+            }
+
+        public:
+            Iterator() {}
+
+            Iterator(const Splitter* splitter): splitter(splitter), rest(splitter->str.data()) {
+                next();
+            }
+
+            string_view operator*() const {
+                return token;
+            }
+
+            const string_view* operator->() const {
+                return &token;
+            }
+
+            Iterator& operator++() {
+                next();
+                return *this;
+            }
+
+            bool operator==(const Iterator& other) const {
+                return splitter == other.splitter && (!splitter || token.data() == other.token.data());
+            }
+
+            bool operator!=(const Iterator& other) const {
+                return !(*this == other);
+            }
+        };
+
+        Splitter(string_view str, string_view delimiter, split_policy policy = SPLIT_KEEP_EMPTY)
+            : str(str.data() ? str : string_view("")), delimiter(delimiter), policy(policy) {}
+
+        Iterator begin() const {
+            return Iterator(this);
+        }
+
+        Iterator end() const {
+            return Iterator();
+        }
+    };
+
+    inline Splitter split(string_view str, string_view delimiter, split_policy policy = SPLIT_KEEP_EMPTY) {
+        return Splitter(str, delimiter, policy);
+    }
+
+    // the tokens into the vector (reused), returns the number of them
+    inline size_t split(string_view str, string_view delimiter, vector<string_view>& tokens, split_policy policy = SPLIT_KEEP_EMPTY) {
+        tokens.clear();
+        for (string_view token: Splitter(str, delimiter, policy)) tokens.push_back(token);
+        return tokens.size();
+    }
+
+}
@@ -4,9 +4,14 @@
 #include <string>
 #include <sstream>
 #include <iostream>
-#include <regex>
 #include <libgen.h> // for dirname()
 #include <limits.h>
+#include <string_view>
+#include <vector>
+#include "TimeZone.h"
+#include "Regex.h"
+#include "split.h"
+#include "format.h"
 
 using namespace std;
 
@@ -48,9 +53,9 @@ namespace lib {
     #define ERROR_MESSAGE(...) concat(COLOR_ERROR, "[ERROR] ", __VA_ARGS__, " " COLOR_FILENAME __FILE__, ":", __LINE__, COLOR_DEFAULT)
     #define ERROR(...) runtime_error(ERROR_MESSAGE(__VA_ARGS__))
 
-    #define PRINT(...) cout << concat(COLOR_DEFAULT, __VA_ARGS__) << endl;
+    #define PRINT(...) str_write(cout, COLOR_DEFAULT, __VA_ARGS__) << endl;
 
-    #define DBG(...) cout << concat(COLOR_DEBUG, "[DEBUG] (", join(", ", __VA_ARGS__), ") " COLOR_FILENAME __FILE__, ":", __LINE__, COLOR_DEFAULT) << endl
+    #define DBG(...) str_write(cout, COLOR_DEBUG, "[DEBUG] (", join(", ", __VA_ARGS__), ") " COLOR_FILENAME __FILE__, ":", __LINE__, COLOR_DEFAULT) << endl
 
     #define __DIR__ str_dirname(__FILE__)
 
@@ -125,63 +130,187 @@ namespace lib {
         return str;
     }
 
+    // see format.h
     template <typename... T>
-    inline string join(const string& glue, T... args) {
-        ostringstream oss;
-        ((oss << args << glue), ...);
-        return join_remove_last_glue(oss, glue);
+    inline string join(const string& glue, const T&... args) {
+        string str;
+        return str_append_join(str, glue, args...);
     }
 
     template <typename T>
-    inline string join(const string& glue, vector<T> vec) {
-        ostringstream oss;
-        for(const T& v: vec) oss << v << glue;
-        return join_remove_last_glue(oss, glue);
+    inline string join(const string& glue, const vector<T>& vec) {
+        string str;
+        str.reserve(vec.size() * (glue.size() + (vec.empty() ? 0 : str_size(vec[0]))));
+        for (size_t i = 0; i < vec.size(); i++) {
+            if (i) str += glue;
+            str_append_one(str, vec[i]);
+        }
+        return str;
     }
 
     template <typename... T>
-    inline string concat(T... args) {
-        return join("", args...);
+    inline string concat(const T&... args) {
+        string str;
+        return str_append(str, args...);
     }
 
     inline string quote(const string& str, const string& quote = "\"") {
         return quote + str + quote;
     }
 
+    // the pattern is compiled once (see Regex::cached())
     inline int reg_match(const string& pattern, const string& str, vector<string>* matches = nullptr) {
-        regex r(pattern);
-        smatch m;
-        if (regex_search(str, m, r)) {
-            if (matches != nullptr) {
-                // Clear the vector before adding new matches
-                matches->clear();
-                for (unsigned int i = 0; i < m.size(); i++) {
-                    matches->push_back(m[i].str());
-                }
+        return Regex::cached(pattern)->match(str, matches);
+    }
+
+    // the group of all the matches as views into the string (the vector is reused), returns the number of the matches
+    inline size_t reg_match_all(const string& pattern, string_view str, vector<string_view>* matches = nullptr, size_t group = 0) {
+        if (matches) matches->clear();
+        size_t count = 0;
+        shared_ptr<const Regex> regex = Regex::cached(pattern);
+        for (Regex::Match match: regex->all(str)) {
+            if (matches) matches->push_back(match[group]);
+            count++;
+        }
+        return count;
+    }
+
+    #define DATE_PARSE_OK 0
+    #define DATE_PARSE_SYNTAX_ERROR 1
+    #define DATE_PARSE_RANGE_ERROR 2
+
+    #define DATE_INVALID LONG_MIN
+
+    // Parses "YYYY[-MM[-DD[( |T)hh[:mm[:ss[(.|,)fraction]]]]]][Z|(+|-)hh[:][mm]]" into ms without
+    // allocations and locks, the missing fields default to the start of the period (as date_parse() does).
+    // The time is UTC unless local is set (or an offset/Z is given), local is by TimeZone::local().
+    // Returns DATE_PARSE_OK or the error, ms is set only when it's OK.
+    inline int date_parse(string_view str, long& ms, bool local = false) {
+        const char* p = str.data();
+        const char* end = p + str.size();
+        auto digits = [&](int n, unsigned& value) {
+            if (end - p < n) return false;
+            value = 0;
+            for (int i = 0; i < n; i++) {
+                unsigned digit = (unsigned char)p[i] - '0';
+                if (digit > 9) return false;
+                value = value * 10 + digit;
             }
-            return 1;
+            p += n;
+            return true;
+        };
+
+        unsigned year, month = 1, day = 1, hour = 0, minute = 0, second = 0, millis = 0;
+        if (!digits(4, year)) return DATE_PARSE_SYNTAX_ERROR;
+        if (p < end && *p == '-') {
+            p++;
+            if (!digits(2, month)) return DATE_PARSE_SYNTAX_ERROR;
+            if (p < end && *p == '-' && (++p, !digits(2, day))) return DATE_PARSE_SYNTAX_ERROR;
         }
-        return 0;
+        if (p < end && (*p == ' ' || *p == 'T')) {
+            p++;
+            if (!digits(2, hour)) return DATE_PARSE_SYNTAX_ERROR;
+            if (p < end && *p == ':' && (++p, !digits(2, minute))) return DATE_PARSE_SYNTAX_ERROR;
+            if (p < end && *p == ':' && (++p, !digits(2, second))) return DATE_PARSE_SYNTAX_ERROR;
+            if (p < end && (*p == '.' || *p == ',')) {
+                p++;
+                int n = 0;
+                for (; p < end && (unsigned)(*p - '0') <= 9; p++, n++)
+                    if (n < 3) millis = millis * 10 + (*p - '0');
+                if (!n) return DATE_PARSE_SYNTAX_ERROR;
+                for (; n < 3; n++) millis *= 10;
+            }
+        }
+        long offset = 0; // seconds east of UTC
+        bool zoned = false;
+        if (p < end && *p == 'Z') {
+            p++;
+            zoned = true;
+        } else if (p < end && (*p == '+' || *p == '-')) {
+            int sign = *p++ == '-' ? -1 : 1;
+            unsigned oh, om = 0;
+            if (!digits(2, oh)) return DATE_PARSE_SYNTAX_ERROR;
+            bool colon = p < end && *p == ':';
+            if (colon) p++;
+            if ((colon || p < end) && !digits(2, om)) return DATE_PARSE_SYNTAX_ERROR; // no dangling ':'
+            if (oh > 23 || om > 59) return DATE_PARSE_RANGE_ERROR;
+            offset = sign * (long)(oh * 3600 + om * 60);
+            zoned = true;
+        }
+        if (p != end) return DATE_PARSE_SYNTAX_ERROR;
+        if (month < 1 || month > 12 || day < 1 || day > days_in_month(year, month) ||
+            hour > 23 || minute > 59 || second > 60) return DATE_PARSE_RANGE_ERROR;
+
+        long seconds = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+        seconds = local && !zoned ? TimeZone::local().fromLocal(seconds) : seconds - offset;
+        ms = seconds * 1000 + millis;
+        return DATE_PARSE_OK;
     }
 
-    inline unsigned long date_parse(const string& date_string) {
-        if (date_string.empty()) return 0;
+    // parses the dates into out (DATE_INVALID for the wrong ones), returns the number of the errors
+    inline size_t date_parse(const string_view* dates, size_t count, long* out, bool local = false) {
+        size_t errors = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (date_parse(dates[i], out[i], local) != DATE_PARSE_OK) {
+                out[i] = DATE_INVALID;
+                errors++;
+            }
+        }
+        return errors;
+    }
+
+    // parses a buffer of dates, one per line (the empty lines are skipped), appends them to out
+    // (DATE_INVALID for the wrong ones), returns the number of the errors
+    inline size_t date_parse_lines(string_view buffer, vector<long>& out, bool local = false, char delimiter = '\n') {
+        size_t errors = 0;
+        while (!buffer.empty()) {
+            size_t at = buffer.find(delimiter);
+            string_view line = buffer.substr(0, at);
+            buffer.remove_prefix(at == string_view::npos ? buffer.size() : at + 1);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.empty()) continue;
+            long ms;
+            if (date_parse(line, ms, local) != DATE_PARSE_OK) {
+                ms = DATE_INVALID;
+                errors++;
+            }
+            out.push_back(ms);
+        }
+        return errors;
+    }
 
-        struct tm time_info = {};
-        int milliseconds = 0;
-        
-        int size = date_string.size();
-        time_info.tm_year = (size > 3 ? stoi(date_string.substr(0, 4)) : 1970) - 1900;
-        time_info.tm_mon = (size > 6 ? stoi(date_string.substr(5, 2)) : 1) - 1;
-        time_info.tm_mday = size > 9 ? stoi(date_string.substr(8, 2)) : 1;
-        time_info.tm_hour = size > 12 ? stoi(date_string.substr(11, 2)) : 0;
-        time_info.tm_min = size > 15 ? stoi(date_string.substr(14, 2)) : 0;
-        time_info.tm_sec = size > 18 ? stoi(date_string.substr(17, 2)) : 0;
-        milliseconds = size > 22 ? stoi(date_string.substr(20, 3)) : 0;
+    // The legacy fixed positions "YYYY?MM?DD?hh?mm?ss?fff" with any separators, each field read as stoi()
+    // did (from its position up to the first non-digit) and the out of range ones rolled over as mktime()
+    // did ("2022-02-30" is 2022-03-02), local time. False without the year or when a field has no digits.
+    inline bool date_parse_legacy(const string& date_string, long& ms) {
+        struct Field { size_t at, len; long value; } fields[] = {
+            { 0, 4, 1970 }, { 5, 2, 1 }, { 8, 2, 1 }, { 11, 2, 0 }, { 14, 2, 0 }, { 17, 2, 0 }, { 20, 3, 0 }
+        };
+        if (date_string.size() < 4) return false;
+        for (Field& field: fields) {
+            if (date_string.size() <= field.at + field.len - 1) break;
+            string digits = date_string.substr(field.at, field.len);
+            char* stop;
+            field.value = strtol(digits.c_str(), &stop, 10);
+            if (stop == digits.c_str()) return false;
+        }
+        long month = fields[1].value - 1;
+        long year = fields[0].value + (month >= 0 ? month / 12 : (month - 11) / 12);
+        month -= (year - fields[0].value) * 12;
+        long seconds = (days_from_civil(year, month + 1, 1) + fields[2].value - 1) * 86400 +
+            fields[3].value * 3600 + fields[4].value * 60 + fields[5].value;
+        ms = TimeZone::local().fromLocal(seconds) * 1000 + fields[6].value;
+        return true;
+    }
 
-        // Convert the struct tm to milliseconds
-        unsigned long seconds = mktime(&time_info);
-        return seconds * 1000 + milliseconds;
+    // local time, throws on invalid dates, 0 for an empty one. What the strict parser refuses is read
+    // by the legacy fixed positions (see date_parse_legacy()), as this overload always did.
+    inline unsigned long date_parse(const string& date_string) {
+        if (date_string.empty()) return 0;
+        long ms;
+        if (date_parse(string_view(date_string), ms, true) != DATE_PARSE_OK && !date_parse_legacy(date_string, ms))
+            throw ERROR("Invalid date: ", date_string);
+        return ms;
     }
 
 
@@ -209,13 +338,10 @@ namespace lib {
         return status;
     }
 
+    // as getline() splits (no trailing empty token), see split() for the views
     inline vector<string> explode(char delimiter, const string& str) {
         vector<string> tokens;
-        stringstream ss(str);
-        string token;
-        while (getline(ss, token, delimiter)) {
-            tokens.push_back(token);
-        }
+        for (string_view token: split(str, string_view(&delimiter, 1), SPLIT_DROP_TRAILING)) tokens.emplace_back(token);
         return tokens;
     }
 }
\ No newline at end of file
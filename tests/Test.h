@@ -3,7 +3,24 @@
 // LCOV_EXCL_START
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <fnmatch.h>
 #include <json/json.h>
 
 #include "../src/lib/utils.h"
@@ -14,20 +31,128 @@ namespace lib {
     #define ERR_TEST_FAILED_MSG "Test failed: "
     #define ERR_TEST_FAILED -1
 
+    // Receives the events of the tests (assertions, test start/end) from any thread.
+    // The base reporter only counts the assertions and collects a record for each test,
+    // the reporters printing the progress or writing the JSON/JUnit files are below the Test class.
+    class TestReporter {
+    public:
+        struct Record {
+            string group; // the top-level test
+            string name;
+            string file;
+            int line;
+            int depth;
+            double ms;
+            bool passed;
+            string error;
+            unsigned long assertions;
+        };
+
+        virtual ~TestReporter() {}
+
+        virtual void assertion(bool passed, const char*) {
+            if (passed) assertions++;
+        }
+
+        virtual void testStart(const char* name, const char*, int, int depth) {
+            if (!depth) group = name;
+            starts.push_back(assertions);
+        }
+
+        virtual void testEnd(const char* name, const char* file, int line, int depth, double ms, const char* error) {
+            unsigned long count = assertions - starts.back();
+            starts.pop_back();
+            record({ group, name, file, line, depth, ms, !error, error ? error : "", count });
+        }
+
+        virtual void record(const Record& record) {
+            lock_guard<mutex> lock(records_mutex);
+            records.push_back(record);
+        }
+
+        // the records collected so far (from the index), e.g. to pass them from a forked test to the runner
+        vector<Record> getRecords(size_t from = 0) {
+            lock_guard<mutex> lock(records_mutex);
+            return vector<Record>(records.begin() + min(from, records.size()), records.end());
+        }
+
+        static Json::Value toJson(const Record& record) {
+            Json::Value json;
+            json["group"] = record.group;
+            json["name"] = record.name;
+            json["file"] = record.file;
+            json["line"] = record.line;
+            json["depth"] = record.depth;
+            json["ms"] = record.ms;
+            json["passed"] = record.passed;
+            json["error"] = record.error;
+            json["assertions"] = (Json::UInt64)record.assertions;
+            return json;
+        }
+
+        static Record fromJson(const Json::Value& json) {
+            return {
+                json["group"].asString(), json["name"].asString(), json["file"].asString(), json["line"].asInt(),
+                json["depth"].asInt(), json["ms"].asDouble(), json["passed"].asBool(), json["error"].asString(),
+                (unsigned long)json["assertions"].asUInt64()
+            };
+        }
+
+        virtual void finish() {}
+
+    protected:
+        static thread_local unsigned long assertions;
+        static thread_local vector<unsigned long> starts; // assertion counts at the start of the running (nested) tests
+        static thread_local string group;
+
+        mutex records_mutex;
+        vector<Record> records;
+    };
+
+    thread_local unsigned long TestReporter::assertions = 0;
+    thread_local vector<unsigned long> TestReporter::starts;
+    thread_local string TestReporter::group;
+
     class Test {
     protected:
 
         static void tick(const char* outp = ".") {
-            printf("%s", outp);
-            fflush(stdout);
+            report().assertion(true, outp);
         }
 
         static void fail(const char* outp = "E") {
-            printf("%s", outp);
-            fflush(stdout);
+            report().assertion(false, outp);
         }
 
     public:
+        // the reporter of the test events, the progress reporter is used when it's not set
+        static TestReporter* reporter;
+        static TestReporter& report();
+
+        // output of the running test, collected into the buffer when it is set
+        // so the parallel tests can print their whole output at once (see TestRunner)
+        static inline thread_local string* buffer = nullptr;
+
+        __attribute__((format(printf, 1, 2)))
+        static void out(const char* fmt, ...) {
+            va_list args;
+            va_start(args, fmt);
+            if (buffer) {
+                va_list size_args;
+                va_copy(size_args, args);
+                int size = vsnprintf(nullptr, 0, fmt, size_args);
+                va_end(size_args);
+                size_t at = buffer->size();
+                buffer->resize(at + size + 1);
+                vsnprintf(&(*buffer)[at], size + 1, fmt, args);
+                buffer->resize(at + size);
+            } else {
+                // no flush here, a syscall for each passed assertion would make the big tests I/O-bound
+                vprintf(fmt, args);
+            }
+            va_end(args);
+        }
+
         static void assertTrue(bool expr, const char* file, int line) {
             if (!expr) {
                 fail();
@@ -47,8 +172,8 @@ namespace lib {
         static void assertLongEquals(long long expected, long long actual, const char* file, int line) {
             if (expected != actual) {
                 fail();
-                printf("\nExpected..: %lld", expected);
-                printf("\nActual....: %lld\n", actual);
+                out("\nExpected..: %lld", expected);
+                out("\nActual....: %lld\n", actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected number is not equal to actual");
             }
             tick();
@@ -57,8 +182,8 @@ namespace lib {
         static void assertDoublesEquals(double expected, double actual, const char* file, int line) {
             if (expected != actual) {
                 fail();
-                printf("\nExpected..: %lf", expected);
-                printf("\nActual....: %lf\n", actual);
+                out("\nExpected..: %lf", expected);
+                out("\nActual....: %lf\n", actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected double is not equal to actual");
             }
             tick();
@@ -67,9 +192,9 @@ namespace lib {
         static void assertDoublesEquals(double expected, double actual, double tolerance, const char* file, int line) {
             if (!(expected - tolerance <= actual && expected + tolerance >= actual)) {
                 fail();
-                printf("\nExpected..: %lf", expected);
-                printf("\nActual....: %lf\n", actual);
-                printf("\n(delta): %lf\n", tolerance);
+                out("\nExpected..: %lf", expected);
+                out("\nActual....: %lf\n", actual);
+                out("\n(delta): %lf\n", tolerance);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected double is not equal to actual");
             }
             tick();
@@ -78,8 +203,8 @@ namespace lib {
         static void assertSizeEquals(size_t expected, size_t actual, const char* file, int line) {
             if (expected != actual) {
                 fail();
-                printf("\nExpected..: %lu", expected);
-                printf("\nActual....: %lu\n", actual);
+                out("\nExpected..: %lu", expected);
+                out("\nActual....: %lu\n", actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected size is not equal to actual");
             }
             tick();
@@ -88,8 +213,8 @@ namespace lib {
         static void assertStringEquals(string expected, string actual, const char* file, int line) {
             if (expected.compare(actual) != 0) {
                 fail();
-                printf("\nExpected..: \"%s\"", expected.c_str());
-                printf("\nActual....: \"%s\"\n", actual.c_str());
+                out("\nExpected..: \"%s\"", expected.c_str());
+                out("\nActual....: \"%s\"\n", actual.c_str());
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected string is not equal to actual");
             }
             tick();
@@ -98,8 +223,8 @@ namespace lib {
         static void assertPointersEquals(void* expected, void* actual, const char* file, int line) {
             if (expected != actual) {
                 fail();
-                printf("\nExpected..: \"%lld\"", (long long)&expected);
-                printf("\nActual....: \"%lld\"\n", (long long)&actual);
+                out("\nExpected..: \"%lld\"", (long long)&expected);
+                out("\nActual....: \"%lld\"\n", (long long)&actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected pointer is not equal to actual");
             }
             tick();
@@ -111,7 +236,7 @@ namespace lib {
             for (size_t i = 0; i < expected.size(); i++) {
                 if (expected[i] != actual[i]) {
                     fail();                
-                    printf("\nfailed at vector[%ld]\n", i);
+                    out("\nfailed at vector[%ld]\n", i);
                     throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected vector is not equal to actual");
                 }
                 tick();
@@ -121,8 +246,8 @@ namespace lib {
         static void assertLongNotEquals(long long expected, long long actual, const char* file, int line) {
             if (expected == actual) {
                 fail();
-                printf("\nExpected..: %lld", expected);
-                printf("\nActual....: %lld\n", actual);
+                out("\nExpected..: %lld", expected);
+                out("\nActual....: %lld\n", actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected number is equal to actual");
             }
             tick();
@@ -131,8 +256,8 @@ namespace lib {
         static void assertDoublesNotEquals(double expected, double actual, const char* file, int line) {
             if (expected == actual) {
                 fail();
-                printf("\nExpected..: %lf", expected);
-                printf("\nActual....: %lf\n", actual);
+                out("\nExpected..: %lf", expected);
+                out("\nActual....: %lf\n", actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected double is equal to actual");
             }
             tick();
@@ -141,9 +266,9 @@ namespace lib {
         static void assertDoublesNotEquals(double expected, double actual, double tolerance, const char* file, int line) {
             if (expected - tolerance <= actual && expected + tolerance >= actual) {
                 fail();
-                printf("\nExpected..: %lf", expected);
-                printf("\nActual....: %lf\n", actual);
-                printf("\n(delta): %lf\n", tolerance);
+                out("\nExpected..: %lf", expected);
+                out("\nActual....: %lf\n", actual);
+                out("\n(delta): %lf\n", tolerance);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected double is equal to actual");
             }
             tick();
@@ -152,8 +277,8 @@ namespace lib {
         static void assertSizeNotEquals(size_t expected, size_t actual, const char* file, int line) {
             if (expected == actual) {
                 fail();
-                printf("\nExpected..: %lu", expected);
-                printf("\nActual....: %lu\n", actual);
+                out("\nExpected..: %lu", expected);
+                out("\nActual....: %lu\n", actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected size is equal to actual");
             }
             tick();
@@ -162,8 +287,8 @@ namespace lib {
         static void assertStringNotEquals(string expected, string actual, const char* file, int line) {
             if (expected.compare(actual) == 0) {
                 fail();
-                printf("\nExpected..: \"%s\"", expected.c_str());
-                printf("\nActual....: \"%s\"\n", actual.c_str());
+                out("\nExpected..: \"%s\"", expected.c_str());
+                out("\nActual....: \"%s\"\n", actual.c_str());
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected string is equal to actual");
             }
             tick();
@@ -182,15 +307,15 @@ namespace lib {
                 }     
             }
             fail();                
-            printf("\nfailed at vector comparison\n");
+            out("\nfailed at vector comparison\n");
             throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected vector is equal to actual");   
         }
 
         static void assertLess(long expected, long actual, const char* file, int line) {
             if (expected >= actual) {
                 fail();
-                printf("\nExpected..: %ld", expected);
-                printf("\nActual....: %ld\n", actual);
+                out("\nExpected..: %ld", expected);
+                out("\nActual....: %ld\n", actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected is not less than actual");
             }
             tick();
@@ -199,8 +324,8 @@ namespace lib {
         static void assertGreater(long expected, long actual, const char* file, int line) {
             if (expected <= actual) {
                 fail();
-                printf("\nExpected..: %ld", expected);
-                printf("\nActual....: %ld\n", actual);
+                out("\nExpected..: %ld", expected);
+                out("\nActual....: %ld\n", actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected is not greather than actual");
             }
             tick();
@@ -209,8 +334,8 @@ namespace lib {
         static void assertLessOrEquals(long expected, long actual, const char* file, int line) {
             if (expected > actual) {
                 fail();
-                printf("\nExpected..: %ld", expected);
-                printf("\nActual....: %ld\n", actual);
+                out("\nExpected..: %ld", expected);
+                out("\nActual....: %ld\n", actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected is not less than or equal to actual");
             }
             tick();
@@ -219,8 +344,8 @@ namespace lib {
         static void assertGreaterOrEquals(long expected, long actual, const char* file, int line) {
             if (expected < actual) {
                 fail();
-                printf("\nExpected..: %ld", expected);
-                printf("\nActual....: %ld\n", actual);
+                out("\nExpected..: %ld", expected);
+                out("\nActual....: %ld\n", actual);
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected is not greather than or equal to actual");
             }
             tick();
@@ -229,8 +354,8 @@ namespace lib {
         static void assertMatch(string exp, string act, const char* file, int line) {
             if (!reg_match(exp, act)) {
                 fail();
-                printf("\nRegexp....: %s", exp.c_str());
-                printf("\nActual....: %s\n", act.c_str());
+                out("\nRegexp....: %s", exp.c_str());
+                out("\nActual....: %s\n", act.c_str());
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "actual is not match to the regular expression");
             }
         }
@@ -238,8 +363,8 @@ namespace lib {
         static void assertNotMatch(string exp, string act, const char* file, int line) {
             if (reg_match(exp, act)) {
                 fail();
-                printf("\nRegexp....: %s", exp.c_str());
-                printf("\nActual....: %s\n", act.c_str());
+                out("\nRegexp....: %s", exp.c_str());
+                out("\nActual....: %s\n", act.c_str());
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "actual is match to the regular expression");
             }
         }
@@ -247,8 +372,8 @@ namespace lib {
         static void assertContains(string exp, string act, const char* file, int line) {
             if (act.find(exp) == string::npos) {
                 fail();
-                printf("\nExpected..: %s", exp.c_str());
-                printf("\nActual....: %s\n", act.c_str());
+                out("\nExpected..: %s", exp.c_str());
+                out("\nActual....: %s\n", act.c_str());
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "actual is not containing the expected substring");
             }
         }
@@ -256,8 +381,8 @@ namespace lib {
         static void assertNotContains(string exp, string act, const char* file, int line) {
             if (act.find(exp) != string::npos) {
                 fail();
-                printf("\nExpected..: %s", exp.c_str());
-                printf("\nActual....: %s\n", act.c_str());
+                out("\nExpected..: %s", exp.c_str());
+                out("\nActual....: %s\n", act.c_str());
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "actual is containing the expected substring");
             }
         }
@@ -282,8 +407,8 @@ namespace lib {
         static void assertJsonEquals(Json::Value expected, Json::Value actual, const char* file, int line) {
             if (expected != actual) {
                 fail();
-                printf("\nExpected..: %s", expected.toStyledString().c_str());
-                printf("\nActual....: %s\n", actual.toStyledString().c_str());
+                out("\nExpected..: %s", expected.toStyledString().c_str());
+                out("\nActual....: %s\n", actual.toStyledString().c_str());
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected Json is not equal to actual");
             }
             tick();
@@ -292,34 +417,149 @@ namespace lib {
         static void assertJsonNotEquals(Json::Value expected, Json::Value actual, const char* file, int line) {
             if (expected == actual) {
                 fail();
-                printf("\nExpected..: %s", expected.toStyledString().c_str());
-                printf("\nActual....: %s\n", actual.toStyledString().c_str());
+                out("\nExpected..: %s", expected.toStyledString().c_str());
+                out("\nActual....: %s\n", actual.toStyledString().c_str());
                 throw ERROR("Fail at ", file, ":", line, " - ", ERR_TEST_FAILED_MSG "expected Json is equal to actual");
             }
             tick();
         }
 
         // -------------
-        static int deepness;
+        static inline thread_local int deepness = 0;
 
-        static void call(void (*func)(void), const char* name, const char* tick = COLOR_SUCCESS "✓\n" COLOR_DEFAULT) {
-            if (deepness) printf("%s", tick);
-            printf("%s", concat("Test running: ", name, "() ").c_str());
-            fflush(stdout);
-            deepness++;
+        static void call(const function<void()>& func, const char* name, const char* file = "", int line = 0) {
+            int depth = deepness++;
+            report().testStart(name, file, line, depth);
             Clock clock;
-            unsigned long before = clock.now();
-            func();
-            unsigned long passed = clock.now() - before;
-            printf(" (%ld ms) ", passed);
-            fflush(stdout);
+            unsigned long long start = clock.nanos();
+            try {
+                func();
+            } catch (exception &e) {
+                deepness--;
+                report().testEnd(name, file, line, depth, (clock.nanos() - start) / 1e6, e.what());
+                throw;
+            } catch (...) {
+                deepness--;
+                report().testEnd(name, file, line, depth, (clock.nanos() - start) / 1e6, "unknown exception");
+                throw;
+            }
             deepness--;
-            if (!deepness) printf("%s", tick);
+            report().testEnd(name, file, line, depth, (clock.nanos() - start) / 1e6, nullptr);
+        }
+    };
+
+    TestReporter* Test::reporter = nullptr;
+
+    // Prints "Test running: ..." for each test and a dot for each passed assertion (default)
+    class ProgressReporter: public TestReporter {
+    public:
+        void assertion(bool passed, const char* outp) override {
+            TestReporter::assertion(passed, outp);
+            Test::out("%s", outp);
+        }
+
+        void testStart(const char* name, const char* file, int line, int depth) override {
+            TestReporter::testStart(name, file, line, depth);
+            if (depth) Test::out("%s", COLOR_SUCCESS "✓\n" COLOR_DEFAULT);
+            Test::out("Test running: " COLOR_INFO "%s:%d" COLOR_DEFAULT " %s() ", file, line, name);
             fflush(stdout);
         }
+
+        void testEnd(const char* name, const char* file, int line, int depth, double ms, const char* error) override {
+            TestReporter::testEnd(name, file, line, depth, ms, error);
+            if (error) return;
+            Test::out(" (%ld ms) ", (long)ms);
+            if (!depth) Test::out("%s", COLOR_SUCCESS "✓\n" COLOR_DEFAULT);
+            fflush(stdout);
+        }
+    };
+
+    inline TestReporter& Test::report() {
+        static ProgressReporter progress;
+        return reporter ? *reporter : progress;
+    }
+
+    // Only counts the assertions, prints the summary at the end
+    class QuietReporter: public TestReporter {
+    public:
+        void finish() override {
+            unsigned long count = 0;
+            size_t tests = 0;
+            for (const Record& record: records) {
+                if (!record.depth) count += record.assertions;
+                tests++;
+            }
+            printf("%lu assertions in %zu tests\n", count, tests);
+        }
+    };
+
+    // Saves the test records (file, line, duration, result..) as JSON
+    class JsonReporter: public QuietReporter {
+    protected:
+        string filename;
+
+    public:
+        JsonReporter(const string& filename): filename(filename) {}
+
+        void finish() override {
+            QuietReporter::finish();
+            Json::Value json(Json::arrayValue);
+            for (const Record& record: records) json.append(toJson(record));
+            ofstream(filename) << json;
+            printf("Test report saved: %s\n", filename.c_str());
+        }
     };
 
-    int Test::deepness = 0;
+    // Saves the test records as JUnit XML, a test suite for each top-level test
+    class JUnitReporter: public QuietReporter {
+    protected:
+        string filename;
+
+        static string escape(const string& str) {
+            string escaped;
+            for (char c: str) {
+                switch (c) {
+                    case '&': escaped += "&amp;"; break;
+                    case '<': escaped += "&lt;"; break;
+                    case '>': escaped += "&gt;"; break;
+                    case '"': escaped += "&quot;"; break;
+                    default: escaped += c;
+                }
+            }
+            return escaped;
+        }
+
+    public:
+        JUnitReporter(const string& filename): filename(filename) {}
+
+        void finish() override {
+            QuietReporter::finish();
+            ofstream xml(filename);
+            xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n";
+            for (const Record& suite: records) {
+                if (suite.depth) continue;
+                // the nested tests are the test cases, a suite without nested tests is a test case itself
+                vector<const Record*> testcases;
+                for (const Record& record: records)
+                    if (record.depth == 1 && record.group == suite.group) testcases.push_back(&record);
+                if (testcases.empty()) testcases.push_back(&suite);
+                size_t tests = testcases.size(), failures = 0;
+                string cases;
+                for (const Record* record: testcases) {
+                    if (!record->passed) failures++;
+                    cases += concat(
+                        "    <testcase name=\"", escape(record->name), "\" classname=\"", escape(suite.name),
+                        "\" file=\"", escape(record->file), "\" line=\"", record->line, "\" time=\"", record->ms / 1000, "\"",
+                        record->passed ? "/>\n" : concat(">\n      <failure message=\"", escape(record->error), "\"/>\n    </testcase>\n")
+                    );
+                }
+                xml << "  <testsuite name=\"" << escape(suite.name) << "\" tests=\"" << tests << "\" failures=\"" << failures
+                    << "\" time=\"" << suite.ms / 1000 << "\">\n" << cases << "  </testsuite>\n";
+            }
+            xml << "</testsuites>\n";
+            printf("Test report saved: %s\n", filename.c_str());
+        }
+    };
 
     #define ASSERT_TRUE(exp) Test::assertTrue(exp, __FILE__, __LINE__)
     #define ASSERT_FALSE(exp) Test::assertFalse(exp, __FILE__, __LINE__)
@@ -350,7 +590,581 @@ namespace lib {
     #define ASSERT_NOT_CONTAINS(exp, act) Test::assertNotContains(exp, act, __FILE__, __LINE__)
     #define ASSERT_THROWS_CONTAINS(func, exctyp, expmsg) Test::assertThrowsContains([&](){ func; }, typeid(exctyp).name(), expmsg, __FILE__, __LINE__)
 
-    #define TEST(func) Test::call(func, concat(COLOR_INFO __FILE__, ":", __LINE__, COLOR_DEFAULT, " ", QUOTEME(func)).c_str())
+    #define TEST(func) Test::call(func, QUOTEME(func), __FILE__, __LINE__)
+
+    // Microbenchmarks: BENCH(func) measures func() as one iteration of the work.
+    // Only runs with --bench, otherwise the function is called once as a smoke test.
+    // Options: --bench-time ms (per benchmark), --bench-json file (results),
+    // --bench-baseline file (results of an earlier run to compare with),
+    // --bench-threshold percent (median slowdown over the baseline counted as a failure)
+    class Bench {
+    public:
+        struct Options {
+            bool enabled = false;
+            double time_ms = 200;
+            size_t samples = 100;
+            string json;
+            string baseline;
+            double threshold = 10;
+        };
+
+        struct Stats {
+            string name;
+            size_t iterations; // per sample
+            double min_ns;
+            double median_ns;
+            double p99_ns;
+            double mean_ns;
+            double stddev_ns;
+        };
+
+        static Options options;
+
+        // keeps the value (and the work computed it) from being optimized out
+        template<typename T>
+        static void doNotOptimize(const T& value) {
+            asm volatile("" : : "g"(&value) : "memory");
+        }
+
+        static unsigned long long nanos() {
+            return Clock().nanos();
+        }
+
+        template<typename F>
+        static double measure(F func, size_t iterations) {
+            unsigned long long start = nanos();
+            for (size_t i = 0; i < iterations; i++) func();
+            return nanos() - start;
+        }
+
+        template<typename F>
+        static void run(F func, const char* name) {
+            if (!options.enabled) {
+                func();
+                Test::out(" (%s: skipped, use --bench) ", name);
+                return;
+            }
+
+            // calibration: double the iterations until a sample takes its share of the time
+            double sample_ns = options.time_ms * 1000000 / options.samples;
+            size_t iterations = 1;
+            while (measure(func, iterations) < sample_ns && iterations < (1ul << 40)) iterations *= 2;
+
+            // warm-up ~10% of the time
+            for (size_t i = 0; i < options.samples / 10 + 1; i++) measure(func, iterations);
+
+            vector<double> samples;
+            for (size_t i = 0; i < options.samples; i++) {
+                samples.push_back(measure(func, iterations) / iterations);
+            }
+            sort(samples.begin(), samples.end());
+            double sum = 0;
+            for (double sample: samples) sum += sample;
+            double mean = sum / samples.size();
+            double variance = 0;
+            for (double sample: samples) variance += (sample - mean) * (sample - mean);
+
+            Stats stats = {
+                name, iterations, samples.front(), samples[samples.size() / 2],
+                samples[min(samples.size() - 1, (size_t)(samples.size() * 0.99))],
+                mean, sqrt(variance / samples.size())
+            };
+            Test::out("\n  %-40s median %12.2f ns  min %12.2f ns  p99 %12.2f ns  stddev %10.2f ns  (%zu x %zu iterations) ",
+                name, stats.median_ns, stats.min_ns, stats.p99_ns, stats.stddev_ns, options.samples, iterations);
+            lock_guard<mutex> lock(results_mutex());
+            results().push_back(stats);
+        }
+
+        // saves the results and compares them to the baseline, returns the number of regressions
+        static int finish() {
+            if (!options.enabled) return 0;
+            Json::Value json;
+            for (const Stats& stats: results()) {
+                Json::Value& bench = json["benchmarks"][stats.name];
+                bench["iterations"] = (Json::UInt64)stats.iterations;
+                bench["min_ns"] = stats.min_ns;
+                bench["median_ns"] = stats.median_ns;
+                bench["p99_ns"] = stats.p99_ns;
+                bench["mean_ns"] = stats.mean_ns;
+                bench["stddev_ns"] = stats.stddev_ns;
+            }
+            if (!options.json.empty()) {
+                ofstream(options.json) << json;
+                printf("Benchmark results saved: %s\n", options.json.c_str());
+            }
+            if (options.baseline.empty()) return 0;
+
+            Json::Value baseline;
+            ifstream file(options.baseline);
+            if (!(file >> baseline)) throw ERROR("Unable to read benchmark baseline: ", options.baseline);
+            int regressions = 0;
+            printf("Benchmarks compared to %s (threshold: %.1f%%):\n", options.baseline.c_str(), options.threshold);
+            for (const Stats& stats: results()) {
+                if (!baseline["benchmarks"].isMember(stats.name)) continue;
+                double base = baseline["benchmarks"][stats.name]["median_ns"].asDouble();
+                double change = base ? 100 * (stats.median_ns - base) / base : 0;
+                bool regression = change > options.threshold;
+                if (regression) regressions++;
+                printf("  %s %-40s %12.2f ns -> %12.2f ns (%+.1f%%)\n", 
+                    regression ? COLOR_ERROR "SLOWER" COLOR_DEFAULT : COLOR_SUCCESS "ok    " COLOR_DEFAULT,
+                    stats.name.c_str(), base, stats.median_ns, change);
+            }
+            return regressions;
+        }
+
+    protected:
+        static vector<Stats>& results() {
+            static vector<Stats> results;
+            return results;
+        }
+
+        static mutex& results_mutex() {
+            static mutex results_mutex;
+            return results_mutex;
+        }
+    };
+
+    Bench::Options Bench::options;
+
+    #define BENCH(func) Bench::run(func, QUOTEME(func))
+
+    // Registry of the test cases defined by TEST_CASE() / BENCH_CASE(), filled at startup
+    // in definition order. The cases of a group run together as a top-level group (see TestRunner).
+    // The serial ones (TEST_CASE_SERIAL(), e.g. measuring the real time) never run next to other tests.
+    class TestRegistry {
+    public:
+        struct Case {
+            string group;
+            string name;
+            string file;
+            int line;
+            function<void()> func;
+            bool serial;
+        };
+
+        static vector<Case>& cases() {
+            static vector<Case> cases;
+            return cases;
+        }
+
+        static bool add(const string& group, const string& name, const string& file, int line, const function<void()>& func, bool serial = false) {
+            cases().push_back({ group, name, file, line, func, serial });
+            return true;
+        }
+    };
+
+    #define TEST_CASE(group, func) \
+        void func(); \
+        static bool func##_registered = TestRegistry::add(QUOTEME(group), QUOTEME(func), __FILE__, __LINE__, func); \
+        void func()
+
+    #define TEST_CASE_SERIAL(group, func) \
+        void func(); \
+        static bool func##_registered = TestRegistry::add(QUOTEME(group), QUOTEME(func), __FILE__, __LINE__, func, true); \
+        void func()
+
+    #define BENCH_CASE(group, func) \
+        void func(); \
+        static bool func##_registered = TestRegistry::add(QUOTEME(group), QUOTEME(func), __FILE__, __LINE__, [](){ BENCH(func); }); \
+        void func()
+
+    // Runs the registered test groups (see TestRegistry) and the added ones on a pool of worker threads (-j N) or
+    // one forked process per test (--fork, with --timeout ms for the hung ones), the groups with serial tests
+    // (the tests in fork mode) run alone after the others.
+    // The tests can be selected by --filter and split between the processes or machines by --shard K/N.
+    // Each group (forked test) output is buffered and printed at once when it is finished.
+    // The test events go to the reporter selected by --reporter (see TestReporter).
+    class TestRunner {
+    public:
+        struct Result {
+            string name;
+            string file;
+            int line = 0;
+            bool passed = false;
+            string error;
+            string output;
+            double ms = 0;
+            double cpu_ms = 0;
+        };
+
+    protected:
+        struct Group {
+            function<void()> func;
+            string name;
+            string file;
+            int line;
+            bool serial;
+            vector<TestRegistry::Case> cases; // of the registered groups, forked one by one
+        };
+
+        vector<Group> groups;
+        vector<Result> results;
+        mutex print_mutex;
+        unique_ptr<TestReporter> reporter;
+        vector<string> filters;
+        size_t shard = 1, shards = 1;
+        bool list = false;
+
+        // the name, the group or group/name matches any of the --filter globs
+        bool selected(const string& group, const string& name) const {
+            if (filters.empty()) return true;
+            string path = group + "/" + name;
+            for (const string& filter: filters)
+                if (
+                    !fnmatch(filter.c_str(), name.c_str(), 0) || 
+                    !fnmatch(filter.c_str(), group.c_str(), 0) ||
+                    !fnmatch(filter.c_str(), path.c_str(), 0)
+                ) return true;
+            return false;
+        }
+
+        // selected and falls into this shard, index counts the selected tests
+        bool picked(const string& group, const string& name, size_t& index) const {
+            return selected(group, name) && index++ % shards == shard - 1;
+        }
+
+        // the added groups and the registered cases selected by the filter and the shard
+        vector<Group> selectedGroups() const {
+            vector<Group> selection;
+            size_t index = 0;
+            for (const Group& group: groups)
+                if (picked(group.name, group.name, index)) selection.push_back(group);
+
+            vector<string> names;
+            map<string, vector<TestRegistry::Case>> cases;
+            for (const TestRegistry::Case& test: TestRegistry::cases()) {
+                if (!picked(test.group, test.name, index)) continue;
+                if (!cases.count(test.group)) names.push_back(test.group);
+                cases[test.group].push_back(test);
+            }
+            for (const string& name: names) {
+                const vector<TestRegistry::Case>& group = cases[name];
+                bool serial = false;
+                for (const TestRegistry::Case& test: group) serial |= test.serial;
+                selection.push_back({ [group]() {
+                    for (const TestRegistry::Case& test: group) 
+                        Test::call(test.func, test.name.c_str(), test.file.c_str(), test.line);
+                }, name, group[0].file, group[0].line, serial, group });
+            }
+            return selection;
+        }
+
+        static double now_ms(clockid_t clk) {
+            timespec ts;
+            clock_gettime(clk, &ts);
+            return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+        }
+
+        void print(const Result& result) {
+            lock_guard<mutex> lock(print_mutex);
+            fwrite(result.output.data(), 1, result.output.size(), stdout);
+            fflush(stdout);
+            if (!result.passed) fprintf(stderr, "\n%s\n", result.error.c_str());
+        }
+
+        // runs a group in the current thread, the output goes to the buffer when it's given
+        Result runGroup(const Group& group, string* buffer) {
+            Result result;
+            result.name = group.name;
+            result.file = group.file;
+            result.line = group.line;
+            Test::buffer = buffer;
+            double start = now_ms(CLOCK_MONOTONIC);
+            double cpu_start = now_ms(CLOCK_THREAD_CPUTIME_ID);
+            try {
+                Test::call(group.func, group.name.c_str(), group.file.c_str(), group.line);
+                result.passed = true;
+            } catch (exception &e) {
+                result.error = e.what();
+            }
+            result.ms = now_ms(CLOCK_MONOTONIC) - start;
+            result.cpu_ms = now_ms(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+            Test::buffer = nullptr;
+            if (buffer) result.output = *buffer;
+            return result;
+        }
+
+        void runSerial() {
+            for (const Group& group: groups) {
+                results.push_back(runGroup(group, nullptr));
+                if (!results.back().passed) fprintf(stderr, "\n%s\n", results.back().error.c_str());
+            }
+        }
+
+        void runThreads() {
+            results.resize(groups.size());
+            vector<size_t> parallel, serial;
+            for (size_t i = 0; i < groups.size(); i++) (groups[i].serial ? serial : parallel).push_back(i);
+            atomic<size_t> next(0);
+            vector<thread> workers;
+            for (size_t w = 0; w < min(jobs, parallel.size()); w++) {
+                workers.emplace_back([&]() {
+                    for (size_t i = next++; i < parallel.size(); i = next++) {
+                        string buffer;
+                        results[parallel[i]] = runGroup(groups[parallel[i]], &buffer);
+                        print(results[parallel[i]]);
+                    }
+                });
+            }
+            for (thread& worker: workers) worker.join();
+            for (size_t i: serial) {
+                string buffer;
+                results[i] = runGroup(groups[i], &buffer);
+                print(results[i]);
+            }
+        }
+
+        // a forked test: a case of a registered group (in the group, as it runs without forks, the case
+        // is the only one in its cases) or an added group
+        struct Unit {
+            size_t group;
+            string name;
+            Group test;
+        };
+
+        vector<Unit> forkUnits() const {
+            vector<Unit> units, serial;
+            for (size_t g = 0; g < groups.size(); g++) {
+                const Group& group = groups[g];
+                if (group.cases.empty()) (group.serial ? serial : units).push_back({ g, group.name, group });
+                for (const TestRegistry::Case& test: group.cases) {
+                    (test.serial ? serial : units).push_back({ g, test.name, { [test]() {
+                        Test::call(test.func, test.name.c_str(), test.file.c_str(), test.line);
+                    }, group.name, group.file, group.line, test.serial, { test } } });
+                }
+            }
+            units.insert(units.end(), serial.begin(), serial.end());
+            return units;
+        }
+
+        void runForks() {
+            struct Child {
+                size_t unit;
+                pid_t pid;
+                int fd;
+                FILE* records; // the test records written by the child, as JSON lines
+                double start;
+                Result result;
+            };
+            vector<Unit> units = forkUnits();
+            vector<size_t> pending(groups.size(), 0);
+            vector<unsigned long> assertions(groups.size(), 0);
+            for (const Unit& unit: units) pending[unit.group]++;
+            results.resize(groups.size());
+            for (size_t g = 0; g < groups.size(); g++) {
+                results[g].name = groups[g].name;
+                results[g].file = groups[g].file;
+                results[g].line = groups[g].line;
+                results[g].passed = true;
+            }
+            vector<Child> children;
+            size_t next = 0;
+            while (next < units.size() || !children.empty()) {
+                // a serial test starts when nothing else runs, the others wait for it
+                while (next < units.size() && (children.empty() || (
+                    children.size() < jobs && !units[next].test.serial && !units[children[0].unit].test.serial
+                ))) {
+                    int fds[2];
+                    FILE* records = tmpfile();
+                    if (!records || pipe(fds)) throw ERROR("Unable to create pipe for test: ", units[next].test.name);
+                    fflush(stdout);
+                    fflush(stderr);
+                    pid_t pid = fork();
+                    if (pid < 0) throw ERROR("Unable to fork test: ", units[next].test.name);
+                    if (pid == 0) {
+                        close(fds[0]);
+                        dup2(fds[1], STDOUT_FILENO);
+                        dup2(fds[1], STDERR_FILENO);
+                        close(fds[1]);
+                        size_t from = Test::report().getRecords().size(); // the inherited ones are not ours
+                        Result result = runGroup(units[next].test, nullptr);
+                        if (!result.passed) fprintf(stderr, "\n%s\n", result.error.c_str());
+                        Json::StreamWriterBuilder builder;
+                        builder["indentation"] = "";
+                        for (const TestReporter::Record& record: Test::report().getRecords(from))
+                            fprintf(records, "%s\n", Json::writeString(builder, TestReporter::toJson(record)).c_str());
+                        fflush(records);
+                        fflush(stdout);
+                        fflush(stderr);
+                        exit(result.passed ? 0 : 1); // exit() and not _exit() so the coverage data gets saved
+                    }
+                    close(fds[1]);
+                    children.push_back({ next++, pid, fds[0], records, now_ms(CLOCK_MONOTONIC), Result() });
+                }
+
+                vector<pollfd> pfds;
+                for (const Child& child: children) pfds.push_back({ child.fd, POLLIN, 0 });
+                poll(pfds.data(), pfds.size(), 10);
+
+                for (size_t c = 0; c < children.size();) {
+                    Child& child = children[c];
+                    Result& result = child.result;
+                    char chunk[4096];
+                    ssize_t n = 0;
+                    if (pfds[c].revents) n = read(child.fd, chunk, sizeof(chunk));
+                    if (n > 0) result.output.append(chunk, n);
+
+                    bool timedout = timeout && now_ms(CLOCK_MONOTONIC) - child.start > timeout;
+                    if (timedout) kill(child.pid, SIGKILL);
+                    if (n > 0 || (!timedout && !pfds[c].revents)) {
+                        c++;
+                        continue;
+                    }
+
+                    // output closed (or killed), collect the child
+                    int status = 0;
+                    rusage usage;
+                    wait4(child.pid, &status, 0, &usage);
+                    close(child.fd);
+                    result.ms = now_ms(CLOCK_MONOTONIC) - child.start;
+                    result.cpu_ms = 
+                        usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 +
+                        usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+                    result.passed = !timedout && WIFEXITED(status) && !WEXITSTATUS(status);
+                    const string& name = units[child.unit].name;
+                    if (timedout) result.error = concat(name, ": Timeout after ", timeout, " ms");
+                    else if (WIFSIGNALED(status)) result.error = concat(name, ": Crashed by signal ", WTERMSIG(status), " (", strsignal(WTERMSIG(status)), ")");
+                    else if (!result.passed) result.error = concat(name, ": Failed");
+                    print(result);
+
+                    // the records of the tests go to the reporter as they are, the group's one is merged from them
+                    // (a killed child has none, its test is reported from here)
+                    size_t g = units[child.unit].group;
+                    bool recorded = false;
+                    rewind(child.records);
+                    char line[4096];
+                    string json;
+                    while (fgets(line, sizeof(line), child.records)) {
+                        json += line;
+                        if (json.back() != '\n') continue;
+                        Json::Value value;
+                        istringstream in(json);
+                        json.clear();
+                        if (!(in >> value)) continue;
+                        TestReporter::Record record = TestReporter::fromJson(value);
+                        if (record.depth) Test::report().record(record);
+                        else assertions[g] += record.assertions;
+                        recorded = true;
+                    }
+                    fclose(child.records);
+                    if (!recorded && !units[child.unit].test.cases.empty()) {
+                        const TestRegistry::Case& test = units[child.unit].test.cases[0];
+                        Test::report().record({ test.group, test.name, test.file, test.line, 1, result.ms, false, result.error, 0 });
+                    }
+
+                    Result& group = results[g];
+                    group.ms += result.ms;
+                    group.cpu_ms += result.cpu_ms;
+                    group.output += result.output;
+                    if (!result.passed) {
+                        group.passed = false;
+                        group.error += (group.error.empty() ? "" : "\n") + result.error;
+                    }
+                    if (!--pending[g]) {
+                        Test::report().record({ group.name, group.name, group.file, group.line, 0, group.ms, group.passed, group.error, assertions[g] });
+                    }
+                    pfds.erase(pfds.begin() + c);
+                    children.erase(children.begin() + c);
+                }
+            }
+        }
+
+    public:
+        size_t jobs = 1;
+        bool isolate = false;
+        unsigned long timeout = 0; // ms, forked tests only
+        bool quiet = false; // only the failed groups are listed in the summary
+
+        TestRunner() {}
+
+        // options: -j N or --jobs N, --fork, --timeout ms, --reporter progress|quiet|json|junit,
+        // --report-file file, --filter globs (comma separated), --shard K/N, --list and the benchmark options (see Bench)
+        TestRunner(int argc, char* argv[]) {
+            string reporterName = "progress", reportFile;
+            for (int i = 1; i < argc; i++) {
+                string arg = argv[i];
+                if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) jobs = max(1, atoi(argv[++i]));
+                else if (arg == "--fork") isolate = true;
+                else if (arg == "--timeout" && i + 1 < argc) timeout = strtoul(argv[++i], nullptr, 10);
+                else if (arg == "--reporter" && i + 1 < argc) reporterName = argv[++i];
+                else if (arg == "--report-file" && i + 1 < argc) reportFile = argv[++i];
+                else if (arg == "--filter" && i + 1 < argc) filters = explode(',', argv[++i]);
+                else if (arg == "--shard" && i + 1 < argc) {
+                    if (sscanf(argv[++i], "%zu/%zu", &shard, &shards) != 2 || !shard || shard > shards) 
+                        throw ERROR("Invalid shard (K/N expected, 1 <= K <= N): ", argv[i]);
+                }
+                else if (arg == "--list") list = true;
+                else if (arg == "--bench") Bench::options.enabled = true;
+                else if (arg == "--bench-time" && i + 1 < argc) Bench::options.time_ms = atof(argv[++i]);
+                else if (arg == "--bench-json" && i + 1 < argc) Bench::options.json = argv[++i];
+                else if (arg == "--bench-baseline" && i + 1 < argc) Bench::options.baseline = argv[++i];
+                else if (arg == "--bench-threshold" && i + 1 < argc) Bench::options.threshold = atof(argv[++i]);
+            }
+            if (reporterName == "progress") reporter.reset(new ProgressReporter);
+            else if (reporterName == "quiet") reporter.reset(new QuietReporter);
+            else if (reporterName == "json") reporter.reset(new JsonReporter(reportFile.empty() ? "test-report.json" : reportFile));
+            else if (reporterName == "junit") reporter.reset(new JUnitReporter(reportFile.empty() ? "test-report.xml" : reportFile));
+            else throw ERROR("Unknown test reporter: ", reporterName);
+            quiet = reporterName != "progress";
+            Test::reporter = reporter.get();
+        }
+
+        ~TestRunner() {
+            if (Test::reporter == reporter.get()) Test::reporter = nullptr;
+        }
+
+        void add(const function<void()>& func, const string& name, const string& file = "", int line = 0, bool serial = false) {
+            groups.push_back({ func, name, file, line, serial, {} });
+        }
+
+        const vector<Result>& getResults() const {
+            return results;
+        }
+
+        // returns the number of failed groups
+        int run() {
+            if (list) {
+                size_t index = 0;
+                for (const Group& group: groups)
+                    if (picked(group.name, group.name, index)) printf("%s  " COLOR_INFO "%s:%d" COLOR_DEFAULT "\n", group.name.c_str(), group.file.c_str(), group.line);
+                for (const TestRegistry::Case& test: TestRegistry::cases()) 
+                    if (picked(test.group, test.name, index)) printf("%s/%s  " COLOR_INFO "%s:%d" COLOR_DEFAULT "\n", test.group.c_str(), test.name.c_str(), test.file.c_str(), test.line);
+                return 0;
+            }
+
+            vector<Group> all = selectedGroups();
+            groups.swap(all);
+            results.clear();
+            double start = now_ms(CLOCK_MONOTONIC);
+            double cpu_start = now_ms(CLOCK_PROCESS_CPUTIME_ID);
+            if (isolate) runForks();
+            else if (jobs > 1) runThreads();
+            else runSerial();
+            double ms = now_ms(CLOCK_MONOTONIC) - start;
+            double cpu_ms = now_ms(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+
+            int failed = 0;
+            double groups_cpu_ms = 0;
+            printf("\n");
+            if (!quiet) printf("Test groups (%s, %zu jobs):\n", isolate ? "forked" : (jobs > 1 ? "threads" : "serial"), jobs);
+            for (const Result& result: results) {
+                if (!quiet || !result.passed) printf("  %s %9.1f ms %9.1f ms cpu  " COLOR_INFO "%s:%d" COLOR_DEFAULT " %s\n",
+                    result.passed ? COLOR_SUCCESS "pass" COLOR_DEFAULT : COLOR_ERROR "FAIL" COLOR_DEFAULT,
+                    result.ms, result.cpu_ms, result.file.c_str(), result.line, result.name.c_str());
+                if (!result.passed) failed++;
+                groups_cpu_ms += result.cpu_ms;
+            }
+            if (isolate) cpu_ms += groups_cpu_ms;
+            printf("Total: %zu groups, %d failed, %.1f ms wall-clock, %.1f ms cpu\n", results.size(), failed, ms, cpu_ms);
+            groups.swap(all);
+            Test::report().finish();
+            failed += Bench::finish();
+            fflush(stdout);
+            return failed;
+        }
+    };
+
+    #define TEST_ADD(runner, func) (runner).add(func, QUOTEME(func), __FILE__, __LINE__)
     
 }
 
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <fstream>
+#include <fcntl.h>
+#include "../Test.h"
+#include "../../src/lib/utils.h"
+#include "../../src/lib/datef.h"
+#include "../../src/lib/TimerWheel.h"
+#include "../../src/lib/Logger.h"
+#include "../../src/lib/Process.h"
+
+using namespace lib;
+
+BENCH_CASE(bench_lib, bench_lib_join) {
+    Bench::doNotOptimize(join(", ", "apple", 42, 3.14, "pear"));
+}
+
+// the join() before format.h: ostringstream, arguments by value, the last glue erased from a copy
+BENCH_CASE(bench_lib, bench_lib_join_legacy) {
+    ostringstream oss;
+    string glue = ", ";
+    oss << "apple" << glue << 42 << glue << 3.14 << glue << "pear" << glue;
+    Bench::doNotOptimize(join_remove_last_glue(oss, glue));
+}
+
+BENCH_CASE(bench_lib, bench_lib_concat_message) {
+    Bench::doNotOptimize(concat("Invalid date: ", string("2022-04-x8"), " at line ", 1234, " of ", 5678.5));
+}
+
+// appending into a reused string, no allocations
+BENCH_CASE(bench_lib, bench_lib_str_append) {
+    static string out;
+    out.clear();
+    Bench::doNotOptimize(str_append(out, "Invalid date: ", string_view("2022-04-x8"), " at line ", 1234, " of ", 5678.5).size());
+}
+
+BENCH_CASE(bench_lib, bench_lib_str_sink) {
+    size_t size = 0;
+    str_sink([&](string_view str) { size = str.size(); }, "Invalid date: ", "2022-04-x8", " at line ", 1234, " of ", 5678.5);
+    Bench::doNotOptimize(size);
+}
+
+BENCH_CASE(bench_lib, bench_lib_datef) {
+    Bench::doNotOptimize(datef(1651160700123));
+}
+
+// a log line and a file name in turn (the formats of both stay cached)
+BENCH_CASE(bench_lib, bench_lib_datef_interleaved) {
+    static long ms = 1651160700000;
+    Bench::doNotOptimize(datef(ms));
+    Bench::doNotOptimize(datefYMD(ms++));
+}
+
+// the datef() before DateFormat: gmtime_r, strftime and sprintf per call
+inline string bench_lib_datef_legacy_impl(long ms) {
+    long sec = ms / 1000;
+    long mil = ms % 1000;
+    struct tm converted_time;
+    gmtime_r(&sec, &converted_time);
+    char time_sbuff[26];
+    strftime(time_sbuff, 26, "%Y-%m-%d %H:%M:%S", &converted_time);
+    char out_sbuff[42];
+    sprintf(out_sbuff, "%s.%03ld", time_sbuff, mil);
+    return string(out_sbuff);
+}
+
+BENCH_CASE(bench_lib, bench_lib_datef_legacy) {
+    Bench::doNotOptimize(bench_lib_datef_legacy_impl(1651160700123));
+}
+
+BENCH_CASE(bench_lib, bench_lib_DateFormat_buffer) {
+    static DateFormat format;
+    static long ms = 1651160700000;
+    char buff[32];
+    Bench::doNotOptimize(format.format(ms++, buff, sizeof(buff))); // a new second in every 1000
+    Bench::doNotOptimize(buff);
+}
+
+// a column of 1000 log timestamps, ~3 ms apart
+BENCH_CASE(bench_lib, bench_lib_DateFormat_batch) {
+    static DateFormat format;
+    static vector<long> column;
+    static vector<char> records(1000 * 24);
+    for (long i = column.size(); i < 1000; i++) column.push_back(1651160700000 + i * 3);
+    Bench::doNotOptimize(format.format(column.data(), column.size(), records.data(), 24));
+}
+
+BENCH_CASE(bench_lib, bench_lib_date_parse) {
+    Bench::doNotOptimize(date_parse("2022-04-28 15:45:00.123"));
+}
+
+BENCH_CASE(bench_lib, bench_lib_date_parse_utc) {
+    long ms;
+    Bench::doNotOptimize(date_parse("2022-04-28 15:45:00.123", ms));
+    Bench::doNotOptimize(ms);
+}
+
+// a log of 1000 timestamps, ~3 ms apart
+BENCH_CASE(bench_lib, bench_lib_date_parse_lines) {
+    static string log;
+    static vector<long> parsed;
+    if (log.empty()) for (long i = 0; i < 1000; i++) log += datef(1651160700000 + i * 3) + "\n";
+    parsed.clear();
+    Bench::doNotOptimize(date_parse_lines(log, parsed));
+    Bench::doNotOptimize(parsed.data());
+}
+
+// 1 MB of csv lines, 8 fields each
+inline const string& bench_lib_split_csv() {
+    static string csv;
+    if (csv.empty()) while (csv.size() < 1024 * 1024) csv += "2022-04-28 15:45:00.123,GET,/index.html,200,1532,0.012,Mozilla/5.0,-\n";
+    return csv;
+}
+
+// what explode() did
+BENCH_CASE(bench_lib, bench_lib_explode_getline) {
+    vector<string> tokens;
+    stringstream ss(bench_lib_split_csv());
+    string token;
+    while (getline(ss, token, ',')) tokens.push_back(token);
+    Bench::doNotOptimize(tokens.size());
+}
+
+BENCH_CASE(bench_lib, bench_lib_explode) {
+    Bench::doNotOptimize(explode(',', bench_lib_split_csv()).size());
+}
+
+BENCH_CASE(bench_lib, bench_lib_split_views) {
+    static vector<string_view> tokens;
+    Bench::doNotOptimize(split(bench_lib_split_csv(), ",", tokens));
+}
+
+BENCH_CASE(bench_lib, bench_lib_split_lazy) {
+    size_t bytes = 0;
+    for (string_view line: split(bench_lib_split_csv(), "\n", SPLIT_DROP_TRAILING))
+        for (string_view field: split(line, ",")) bytes += field.size();
+    Bench::doNotOptimize(bytes);
+}
+
+BENCH_CASE(bench_lib, bench_lib_split_multichar) {
+    size_t count = 0;
+    for (string_view token: split(bench_lib_split_csv(), ",-\n")) count += !token.empty();
+    Bench::doNotOptimize(count);
+}
+
+// a log line: formatted and flushed by the calling thread (as PRINT does) vs queued for the writer thread
+BENCH_CASE(bench_lib, bench_lib_log_endl) {
+    static ofstream out("/dev/null");
+    out << datef() << " [INFO] request " << 42 << " took " << 0.5 << " ms" << endl;
+}
+
+BENCH_CASE(bench_lib, bench_lib_Logger_log) {
+    static int fd = open("/dev/null", O_WRONLY);
+    static Logger logger(fd, 1024 * 1024, true);
+    Bench::doNotOptimize(logger.log(LOGGER_LEVEL_INFO, __FILE__, __LINE__, "request ", 42, " took ", 0.5, " ms"));
+}
+
+// a short command: popen() through a shell vs posix_spawn() without one
+BENCH_CASE(bench_lib, bench_lib_exec_popen) {
+    string output;
+    Bench::doNotOptimize(exec("echo hello", output));
+}
+
+BENCH_CASE(bench_lib, bench_lib_Process_run) {
+    Bench::doNotOptimize(Process::run({ "echo", "hello" }).status);
+}
+
+// 16 commands one by one vs 8 at once
+BENCH_CASE(bench_lib, bench_lib_Process_serial_16) {
+    for (int i = 0; i < 16; i++) Bench::doNotOptimize(Process::run({ "sleep", "0.001" }).status);
+}
+
+BENCH_CASE(bench_lib, bench_lib_exec_many_16) {
+    Bench::doNotOptimize(exec_many(vector<vector<string>>(16, { "sleep", "0.001" }), 8).size());
+}
+
+// counting the lines of a large output: collected and exploded vs streamed
+BENCH_CASE(bench_lib, bench_lib_Process_buffered_lines) {
+    ProcessResult result = Process::run({ "seq", "1", "200000" });
+    Bench::doNotOptimize(explode('\n', result.out).size());
+}
+
+BENCH_CASE(bench_lib, bench_lib_exec_lines) {
+    size_t lines = 0;
+    exec_lines({ "seq", "1", "200000" }, [&](string_view) { lines++; });
+    Bench::doNotOptimize(lines);
+}
+
+// a repeated pattern: compiled on each call (as reg_match() did), cached, precompiled
+BENCH_CASE(bench_lib, bench_lib_regex_compile) {
+    Bench::doNotOptimize(regex_search(string("2022-04-28 15:45:00.123 [ERROR] disk full"), regex("\\[(ERROR|WARN)\\]")));
+}
+
+BENCH_CASE(bench_lib, bench_lib_reg_match) {
+    Bench::doNotOptimize(reg_match("\\[(ERROR|WARN)\\]", "2022-04-28 15:45:00.123 [ERROR] disk full"));
+}
+
+BENCH_CASE(bench_lib, bench_lib_Regex_match) {
+    static Regex regex("\\[(ERROR|WARN)\\]");
+    static vector<string_view> captures;
+    Bench::doNotOptimize(regex.match("2022-04-28 15:45:00.123 [ERROR] disk full", captures));
+}
+
+// the local offset lookup vs libc's (which checks TZ under a global lock)
+BENCH_CASE(bench_lib, bench_lib_TimeZone_offset) {
+    static long sec = 1651160700;
+    Bench::doNotOptimize(TimeZone::local().offset(sec++));
+}
+
+BENCH_CASE(bench_lib, bench_lib_localtime_r) {
+    static time_t sec = 1651160700;
+    struct tm tm;
+    sec++;
+    Bench::doNotOptimize(localtime_r(&sec, &tm));
+}
+
+BENCH_CASE(bench_lib, bench_lib_Clock_now) {
+    Bench::doNotOptimize(Clock().now());
+}
+
+// the real clock of the coarse benchmarks, with its own ticker (the process-wide coarse mode stays off)
+inline Clock* bench_lib_coarse_clock = nullptr;
+
+void bench_lib_Clock_now_coarse_ticker() {
+    Bench::doNotOptimize(bench_lib_coarse_clock->now());
+}
+
+void bench_lib_Clock_now_coarse_kernel() {
+    Bench::doNotOptimize(bench_lib_coarse_clock->now());
+}
+
+void bench_lib_datef_now_coarse() {
+    Bench::doNotOptimize(datef(bench_lib_coarse_clock->now()));
+}
+
+// same as bench_lib_Clock_now and datef() in the coarse modes
+TEST_CASE(bench_lib, bench_lib_Clock_coarse) {
+    Clock::Ticker ticker(1), kernel(0);
+    Clock ticked(ticker), kernel_clock(kernel);
+    bench_lib_coarse_clock = &ticked;
+    BENCH(bench_lib_Clock_now_coarse_ticker);
+    BENCH(bench_lib_datef_now_coarse);
+    bench_lib_coarse_clock = &kernel_clock;
+    BENCH(bench_lib_Clock_now_coarse_kernel);
+    bench_lib_coarse_clock = nullptr;
+}
+
+// one 1 ms tick of N repeating timeouts (1..1000 ms) on a timer wheel and by polling the Timers
+struct bench_lib_timers {
+    Clock clock;
+    TimerWheel wheel;
+    vector<Timer> timers;
+    size_t fired = 0;
+
+    bench_lib_timers(size_t n, bool wheeled): clock(1000), wheel(clock) {
+        for (size_t i = 0; i < n; i++) {
+            if (wheeled) wheel.schedule(1 + i % 1000, [this]() { fired++; }, true);
+            else timers.emplace_back(clock, 1 + i % 1000);
+        }
+    }
+
+    void tick() {
+        clock.delay(1);
+        for (Timer& timer: timers) fired += timer.check();
+        fired += wheel.advance();
+        Bench::doNotOptimize(fired);
+    }
+};
+
+void bench_lib_TimerWheel_advance_1k() {
+    static bench_lib_timers timers(1000, true);
+    timers.tick();
+}
+
+void bench_lib_TimerWheel_advance_100k() {
+    static bench_lib_timers timers(100000, true);
+    timers.tick();
+}
+
+void bench_lib_Timer_check_1k() {
+    static bench_lib_timers timers(1000, false);
+    timers.tick();
+}
+
+void bench_lib_Timer_check_100k() {
+    static bench_lib_timers timers(100000, false);
+    timers.tick();
+}
+
+TEST_CASE(bench_lib, bench_lib_TimerWheel_scaling) {
+    BENCH(bench_lib_TimerWheel_advance_1k);
+    BENCH(bench_lib_TimerWheel_advance_100k);
+    BENCH(bench_lib_Timer_check_1k);
+    BENCH(bench_lib_Timer_check_100k);
+}
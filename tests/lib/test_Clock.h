@@ -5,7 +5,7 @@
 
 using namespace lib;
 
-void test_lib_real_Clock() {
+TEST_CASE_SERIAL(test_lib_Clock, test_lib_real_Clock) {
     Clock clock;
     unsigned long start_time = clock.now();
     clock.delay(100);
@@ -13,7 +13,7 @@ void test_lib_real_Clock() {
     ASSERT_TRUE(end_time - start_time >= 100 && end_time - start_time <= 110);
 }
 
-void test_lib_fake_Clock() {
+TEST_CASE(test_lib_Clock, test_lib_fake_Clock) {
     Clock clock(1);
     ASSERT_EQUALS(clock.now(), 1);
 
@@ -27,7 +27,59 @@ void test_lib_fake_Clock() {
     ASSERT_EQUALS(clock.now(), 150);
 }
 
-void test_lib_Clock() {
-    TEST(test_lib_real_Clock);
-    TEST(test_lib_fake_Clock);
-}
\ No newline at end of file
+TEST_CASE_SERIAL(test_lib_Clock, test_lib_real_Clock_nanos) {
+    Clock clock;
+    unsigned long long start = clock.nanos();
+    clock.delayNanos(2000000);
+    unsigned long long passed = clock.nanos() - start;
+    ASSERT_TRUE(passed >= 2000000 && passed < 50000000);
+    ASSERT_THROWS_CONTAINS(clock.setNanos(1), runtime_error, "Can not set time on real clock");
+}
+
+TEST_CASE(test_lib_Clock, test_lib_fake_Clock_nanos) {
+    Clock clock(1);
+    ASSERT_EQUALS(clock.nanos(), 1000000ull);
+
+    clock.delayNanos(1500);
+    ASSERT_EQUALS(clock.nanos(), 1001500ull);
+    ASSERT_EQUALS(clock.now(), 1ul);
+
+    clock.delayNanos(999000);
+    ASSERT_EQUALS(clock.nanos(), 2000500ull);
+    ASSERT_EQUALS(clock.now(), 2ul);
+
+    clock.setNanos(5000001);
+    ASSERT_EQUALS(clock.now(), 5ul);
+    ASSERT_EQUALS(clock.nanos(), 5000001ull);
+
+    clock.set(7); // drops the sub-millisecond part
+    ASSERT_EQUALS(clock.nanos(), 7000000ull);
+
+    Clock null(CLK_NULL);
+    ASSERT_EQUALS(null.nanos(), CLK_NULL_NS);
+}
+
+TEST_CASE(test_lib_Clock, test_lib_coarse_Clock) {
+    // own tickers, the process-wide coarse mode stays off for the other tests
+    Clock::Ticker ticker(2), kernel(0);
+    Clock clock(ticker), fake(100);
+    ASSERT_TRUE(clock.isCoarseTime());
+    ASSERT_FALSE(Clock().isCoarseTime());
+    ASSERT_FALSE(fake.isCoarseTime());
+    unsigned long start = clock.now();
+    clock.delay(20);
+    unsigned long passed = clock.now() - start;
+    ASSERT_TRUE(passed >= 15 && passed <= 30);
+    ASSERT_EQUALS(fake.now(), 100);
+
+    Clock kernel_clock(kernel); // CLOCK_REALTIME_COARSE
+    start = kernel_clock.now();
+    kernel_clock.delay(20);
+    passed = kernel_clock.now() - start;
+    ASSERT_TRUE(passed >= 15 && passed <= 30);
+
+    ticker.stop();
+    ASSERT_FALSE(clock.isCoarseTime());
+    start = clock.now(); // the real time again
+    ASSERT_TRUE(Clock().now() - start <= 1);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <thread>
+#include "../Test.h"
+#include "../../src/lib/EventLoop.h"
+
+using namespace lib;
+
+TEST_CASE(test_lib_EventLoop, test_lib_EventLoop_fake_Clock) {
+    Clock clock(1000);
+    EventLoop loop(clock);
+    vector<unsigned long> fired;
+    loop.schedule(100, [&]() { fired.push_back(clock.now()); });
+    loop.schedule(5000, [&]() { fired.push_back(clock.now()); });
+    ASSERT_TRUE(&loop.getClock() == &clock);
+
+    // jumps to the deadlines instead of sleeping
+    ASSERT_EQUALS(loop.runOnce(), 1ul);
+    ASSERT_EQUALS(clock.now(), 1100ul);
+    ASSERT_EQUALS(loop.runOnce(), 1ul);
+    ASSERT_EQUALS(clock.now(), 6000ul);
+    ASSERT_EQUALS(fired.size(), 2ul);
+    ASSERT_EQUALS(loop.runOnce(), 0ul); // nothing to wait for
+
+    // the timeout comes first
+    TimerWheel::Id id = loop.schedule(1000, [&]() { fired.push_back(clock.now()); });
+    ASSERT_EQUALS(loop.runOnce(10), 0ul);
+    ASSERT_EQUALS(clock.now(), 6010ul);
+    ASSERT_TRUE(loop.cancel(id));
+
+    // repeats until stopped
+    int count = 0;
+    loop.schedule(100, [&]() { if (++count == 3) loop.stop(); }, true);
+    loop.run();
+    ASSERT_EQUALS(count, 3);
+    ASSERT_EQUALS(clock.now(), 6310ul);
+    ASSERT_EQUALS(loop.getTimers().size(), 1ul);
+}
+
+TEST_CASE(test_lib_EventLoop, test_lib_EventLoop_fds) {
+    Clock clock(1000);
+    EventLoop loop(clock);
+    int fds[2];
+    ASSERT_EQUALS(pipe(fds), 0);
+    string received;
+    loop.watch(fds[0], EPOLLIN, [&](uint32_t events) {
+        ASSERT_TRUE(events & EPOLLIN);
+        char buff[16];
+        ssize_t n = read(fds[0], buff, sizeof(buff));
+        received.append(buff, n > 0 ? n : 0);
+    });
+    int fired = 0;
+    loop.schedule(100, [&]() { fired++; });
+
+    // the ready I/O first, without moving the clock
+    ASSERT_EQUALS(write(fds[1], "hello", 5), 5);
+    ASSERT_EQUALS(loop.runOnce(), 1ul);
+    ASSERT_STRING_EQUALS("hello", received);
+    ASSERT_EQUALS(clock.now(), 1000ul);
+    ASSERT_EQUALS(loop.runOnce(), 1ul);
+    ASSERT_EQUALS(fired, 1);
+
+    // no timers: waits for the real I/O
+    thread writer([&]() { 
+        this_thread::sleep_for(chrono::milliseconds(10)); 
+        if (write(fds[1], "world", 5) != 5) throw ERROR("write failed");
+    });
+    ASSERT_EQUALS(loop.runOnce(), 1ul);
+    writer.join();
+    ASSERT_STRING_EQUALS("helloworld", received);
+
+    loop.unwatch(fds[0]);
+    loop.unwatch(fds[0]);
+    ASSERT_EQUALS(loop.runOnce(), 0ul);
+    ASSERT_THROWS_CONTAINS(loop.watch(-1, EPOLLIN, [](uint32_t) {}), runtime_error, "Unable to watch fd -1");
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_CASE_SERIAL(test_lib_EventLoop, test_lib_EventLoop_real_Clock) {
+    Clock clock;
+    EventLoop loop(clock);
+    unsigned long long start = clock.nanos();
+    int count = 0;
+    TimerWheel::Id id = loop.schedule(10, [&]() { if (++count == 3) loop.stop(); }, true);
+    loop.run();
+    unsigned long long passed = (clock.nanos() - start) / CLK_NS_PER_MS;
+    ASSERT_EQUALS(count, 3);
+    ASSERT_TRUE(passed >= 28 && passed < 100);
+    ASSERT_TRUE(loop.cancel(id));
+
+    // woken up by the I/O before the timer
+    int fds[2];
+    ASSERT_EQUALS(pipe(fds), 0);
+    bool read = false;
+    loop.watch(fds[0], EPOLLIN, [&](uint32_t) { read = true; loop.unwatch(fds[0]); });
+    thread writer([&]() { 
+        this_thread::sleep_for(chrono::milliseconds(5)); 
+        if (write(fds[1], "x", 1) != 1) throw ERROR("write failed");
+    });
+    start = clock.nanos();
+    ASSERT_EQUALS(loop.runOnce(1000), 1ul);
+    writer.join();
+    ASSERT_TRUE(read);
+    ASSERT_TRUE((clock.nanos() - start) / CLK_NS_PER_MS < 500);
+
+    // timeout on the real time
+    start = clock.nanos();
+    ASSERT_EQUALS(loop.runOnce(10), 0ul);
+    ASSERT_TRUE((clock.nanos() - start) / CLK_NS_PER_MS >= 9);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// the coarse now() lags the timerfd deadlines, the loop has to sleep and not spin until it catches up
+TEST_CASE_SERIAL(test_lib_EventLoop, test_lib_EventLoop_coarse_Clock) {
+    Clock::Ticker ticker(1), kernel(0);
+    for (Clock::Ticker* coarse: { &ticker, &kernel }) {
+        Clock clock(*coarse);
+        EventLoop loop(clock);
+        int count = 0;
+        loop.schedule(3, [&]() { if (++count == 30) loop.stop(); }, true);
+        timespec cpu_start, cpu_end;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+        unsigned long long start = clock.nanos();
+        loop.run();
+        unsigned long long passed = (clock.nanos() - start) / CLK_NS_PER_MS;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+        double cpu_ms = (cpu_end.tv_sec - cpu_start.tv_sec) * 1000.0 + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e6;
+        ASSERT_TRUE(count >= 30); // the periods overdue at the stop() fire in the same advance()
+        ASSERT_TRUE(passed >= 85);
+        ASSERT_TRUE(cpu_ms < passed / 5.0);
+    }
+}
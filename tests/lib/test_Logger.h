@@ -0,0 +1,127 @@
+#pragma once
+
+#include <thread>
+#include <future>
+#include "../Test.h"
+#include "../../src/lib/Logger.h"
+
+using namespace lib;
+
+// collects the batches of the writer
+class test_lib_Logger_Sink {
+public:
+    mutex lock;
+    string written;
+    size_t batches = 0;
+
+    Logger::Sink sink() {
+        return [this](string_view batch) {
+            lock_guard<mutex> guard(lock);
+            written += batch;
+            batches++;
+        };
+    }
+
+    vector<string> lines() {
+        lock_guard<mutex> guard(lock);
+        vector<string> lines;
+        for (string_view line: split(written, "\n", SPLIT_DROP_TRAILING)) lines.emplace_back(line);
+        return lines;
+    }
+};
+
+// the rings the logging thread holds
+class test_lib_Logger_Rings: public Logger {
+public:
+    static size_t count() {
+        return threadRings().rings.size();
+    }
+};
+
+TEST_CASE(test_lib_Logger, test_lib_Logger_threads) {
+    test_lib_Logger_Sink sink;
+    Clock clock(1651160700123);
+    Logger logger(sink.sink(), 1024 * 1024, false, clock);
+    ASSERT_TRUE(logger.log(LOGGER_LEVEL_INFO, "file.cpp", 12, "hello ", 42));
+    logger.flush();
+    ASSERT_STRING_EQUALS("2022-04-28 15:45:00.123 [INFO] hello 42 file.cpp:12\n", sink.written);
+
+    vector<thread> threads;
+    for (int t = 0; t < 4; t++) threads.emplace_back([&, t]() {
+        for (int i = 0; i < 1000; i++) LOGGER_LOG(logger, LOGGER_LEVEL_WARN, "thread ", t, " line ", i);
+    });
+    for (thread& t: threads) t.join();
+    logger.flush();
+    vector<string> lines = sink.lines();
+    ASSERT_EQUALS(4001, lines.size());
+    ASSERT_EQUALS(4001, logger.getLogged());
+    ASSERT_EQUALS(0, logger.getDropped());
+
+    // the lines of a thread are in order
+    int next[4] = {};
+    for (size_t i = 1; i < lines.size(); i++) {
+        vector<string_view> tokens;
+        split(lines[i], " ", tokens);
+        ASSERT_STRING_EQUALS("[WARN]", string(tokens[2]));
+        int t = tokens[4][0] - '0';
+        ASSERT_STRING_EQUALS(to_string(next[t]++), string(tokens[6]));
+    }
+}
+
+TEST_CASE(test_lib_Logger, test_lib_Logger_levels) {
+    test_lib_Logger_Sink sink;
+    Logger logger(sink.sink());
+    int evaluated = 0;
+    LOGGER_LOG(logger, LOGGER_LEVEL_TRACE, "compiled out ", ++evaluated); // below LOGGER_LEVEL
+    ASSERT_EQUALS(0, evaluated);
+    logger.setLevel(LOGGER_LEVEL_WARN);
+    ASSERT_FALSE(logger.log(LOGGER_LEVEL_INFO, "file.cpp", 1, "filtered"));
+    ASSERT_TRUE(logger.log(LOGGER_LEVEL_ERROR, "file.cpp", 2, "kept"));
+    logger.flush();
+    ASSERT_EQUALS(1, sink.lines().size());
+    ASSERT_CONTAINS("[ERROR] kept file.cpp:2", sink.written);
+}
+
+TEST_CASE(test_lib_Logger, test_lib_Logger_full) {
+    // the writer gets stuck in the sink until released
+    promise<void> release;
+    shared_future<void> released = release.get_future().share();
+    size_t written = 0;
+    Logger dropping([&](string_view batch) {
+        released.wait();
+        written += batch.size();
+    }, 256);
+    size_t dropped = 0;
+    for (int i = 0; i < 100; i++) dropped += !dropping.log(LOGGER_LEVEL_INFO, "file.cpp", 1, "a message of some length");
+    ASSERT_TRUE(dropped > 80);
+    ASSERT_EQUALS(dropped, dropping.getDropped());
+    ASSERT_EQUALS(100 - dropped, dropping.getLogged());
+    ASSERT_FALSE(dropping.log(LOGGER_LEVEL_INFO, "file.cpp", 1, string(300, 'x'))); // never fits
+    release.set_value();
+    dropping.flush();
+    ASSERT_TRUE(written > 0);
+
+    // blocking waits for the writer, nothing lost
+    test_lib_Logger_Sink sink;
+    Logger blocking(sink.sink(), 256, true);
+    for (int i = 0; i < 1000; i++) ASSERT_TRUE(blocking.log(LOGGER_LEVEL_INFO, "file.cpp", 1, "line ", i));
+    blocking.flush();
+    ASSERT_EQUALS(1000, sink.lines().size());
+    ASSERT_EQUALS(0, blocking.getDropped());
+    ASSERT_TRUE(sink.batches > 1);
+}
+
+TEST_CASE(test_lib_Logger, test_lib_Logger_short_lived) {
+    // the rings of the destroyed loggers are freed, not kept until the thread exits
+    thread logging([]() {
+        for (int i = 0; i < 1000; i++) {
+            Logger logger([](string_view) {}, 64 * 1024);
+            logger.log(LOGGER_LEVEL_INFO, "file.cpp", 1, "short lived ", i);
+        }
+        ASSERT_EQUALS(1, test_lib_Logger_Rings::count()); // the last one's
+        Logger logger([](string_view) {});
+        logger.log(LOGGER_LEVEL_INFO, "file.cpp", 1, "long lived");
+        ASSERT_EQUALS(1, test_lib_Logger_Rings::count());
+    });
+    logging.join();
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "../Test.h"
+#include "../../src/lib/Process.h"
+
+using namespace lib;
+
+TEST_CASE(test_lib_Process, test_lib_Process_run) {
+    ProcessResult result = Process::run({ "echo", "hello" });
+    ASSERT_EQUALS(0, result.status);
+    ASSERT_STRING_EQUALS("hello\n", result.out);
+    ASSERT_STRING_EQUALS("", result.err);
+    ASSERT_TRUE(result.started > 0);
+    ASSERT_TRUE(result.elapsed_ns > 0);
+
+    // no shell: the arguments are passed as they are
+    result = Process::run({ "printf", "%s|", "a b", "$HOME", "*" });
+    ASSERT_STRING_EQUALS("a b|$HOME|*|", result.out);
+
+    result = Process::run(Process::shell("echo out; echo err >&2; exit 3"));
+    ASSERT_EQUALS(3, result.status);
+    ASSERT_STRING_EQUALS("out\n", result.out);
+    ASSERT_STRING_EQUALS("err\n", result.err);
+
+    ProcessOptions merged;
+    merged.merge_stderr = true;
+    result = Process::run(Process::shell("echo out; echo err >&2"), merged);
+    ASSERT_STRING_EQUALS("out\nerr\n", result.out);
+
+    // more than the pipe buffers
+    result = Process::run(Process::shell("head -c 1000000 /dev/zero; head -c 300000 /dev/zero >&2"));
+    ASSERT_EQUALS(1000000, result.out.size());
+    ASSERT_EQUALS(300000, result.err.size());
+
+    result = Process::run({ "no-such-command-here" });
+    ASSERT_EQUALS(-1, result.status);
+    ASSERT_CONTAINS("no-such-command-here: No such file or directory", result.error);
+    result = Process::run({});
+    ASSERT_STRING_EQUALS("empty command", result.error);
+}
+
+TEST_CASE_SERIAL(test_lib_Process, test_lib_Process_kill) {
+    // the timeout kills the process group, the children holding the pipe too
+    ProcessOptions options;
+    options.timeout_ms = 100;
+    ProcessResult result = Process::run(Process::shell("echo started; sleep 5 | cat"), options);
+    ASSERT_TRUE(result.timed_out);
+    ASSERT_EQUALS(SIGKILL, result.signal);
+    ASSERT_EQUALS(128 + SIGKILL, result.status);
+    ASSERT_STRING_EQUALS("started\n", result.out);
+    ASSERT_TRUE(result.elapsed_ns < 2000 * CLK_NS_PER_MS);
+
+    Process process(Process::shell("sleep 5"));
+    ASSERT_TRUE(process.isRunning());
+    ASSERT_TRUE(process.kill(SIGTERM));
+    process.wait();
+    ASSERT_FALSE(process.isRunning());
+    ASSERT_FALSE(process.kill());
+    ASSERT_EQUALS(SIGTERM, process.getResult().signal);
+    ASSERT_FALSE(process.getResult().timed_out);
+}
+
+TEST_CASE_SERIAL(test_lib_Process, test_lib_Process_exec_many) {
+    vector<vector<string>> commands;
+    for (int i = 0; i < 8; i++) commands.push_back(Process::shell(concat("sleep 0.1; echo ", i, "; exit ", i)));
+    commands.push_back({ "no-such-command-here" });
+    unsigned long long start = Clock().nanos();
+    vector<ProcessResult> results = exec_many(commands, 4);
+    unsigned long long elapsed = Clock().nanos() - start;
+    ASSERT_EQUALS(9, results.size());
+    for (int i = 0; i < 8; i++) {
+        ASSERT_EQUALS(i, results[i].status);
+        ASSERT_STRING_EQUALS(concat(i, "\n"), results[i].out);
+        ASSERT_TRUE(results[i].elapsed_ns >= 100 * CLK_NS_PER_MS);
+    }
+    ASSERT_EQUALS(-1, results[8].status);
+    // two rounds of 4
+    ASSERT_TRUE(elapsed >= 200 * CLK_NS_PER_MS);
+    ASSERT_TRUE(elapsed < 700 * CLK_NS_PER_MS);
+
+    future<ProcessResult> async = exec_async({ "echo", "async" });
+    ASSERT_STRING_EQUALS("async\n", async.get().out);
+}
+
+TEST_CASE(test_lib_Process, test_lib_Process_stream) {
+    // chunks as they arrive, nothing collected
+    ProcessOptions options;
+    size_t total = 0, chunks = 0, largest = 0;
+    options.on_out = [&](string_view chunk) {
+        total += chunk.size();
+        chunks++;
+        largest = max(largest, chunk.size());
+    };
+    ProcessResult result = Process::run({ "head", "-c", "1000000", "/dev/zero" }, options);
+    ASSERT_EQUALS(0, result.status);
+    ASSERT_EQUALS(1000000, total);
+    ASSERT_TRUE(chunks >= 1000000 / (64 * 1024));
+    ASSERT_TRUE(largest <= 64 * 1024);
+    ASSERT_EQUALS(0, result.out.size());
+
+    // lines, the last one without the '\n' too
+    vector<string> lines;
+    result = exec_lines({ "printf", "a\nbb\n\nccc" }, [&](string_view line) { lines.emplace_back(line); });
+    ASSERT_EQUALS(4, lines.size());
+    ASSERT_STRING_EQUALS("a", lines[0]);
+    ASSERT_STRING_EQUALS("bb", lines[1]);
+    ASSERT_STRING_EQUALS("", lines[2]);
+    ASSERT_STRING_EQUALS("ccc", lines[3]);
+
+    // the lines across the chunks
+    long next = 1;
+    bool ordered = true;
+    exec_lines({ "seq", "1", "100000" }, [&](string_view line) { ordered &= line == to_string(next++); });
+    ASSERT_TRUE(ordered);
+    ASSERT_EQUALS(100001, next);
+
+    ProcessOptions errors;
+    lines.clear();
+    errors.lines = true;
+    errors.on_err = [&](string_view line) { lines.emplace_back(line); };
+    result = Process::run(Process::shell("echo out; echo one >&2; echo two >&2"), errors);
+    ASSERT_STRING_EQUALS("out\n", result.out);
+    ASSERT_EQUALS(2, lines.size());
+    ASSERT_STRING_EQUALS("two", lines[1]);
+
+    // a process per line, the rest of the chunk stays intact
+    lines.clear();
+    exec_lines({ "printf", "a\nbb\nccc\n" }, [&](string_view line) {
+        lines.emplace_back(line);
+        ASSERT_STRING_EQUALS("overwritten?\n", Process::run({ "echo", "overwritten?" }).out);
+    });
+    ASSERT_EQUALS(3, lines.size());
+    ASSERT_STRING_EQUALS("a", lines[0]);
+    ASSERT_STRING_EQUALS("bb", lines[1]);
+    ASSERT_STRING_EQUALS("ccc", lines[2]);
+}
+
+TEST_CASE(test_lib_Process, test_lib_Process_stdin) {
+    // the producer is called only as fast as the child reads
+    size_t left = 10 * 1000 * 1000;
+    ProcessOptions options;
+    options.on_stdin = [&](char* buff, size_t size) {
+        size = min(size, left);
+        memset(buff, 'x', size);
+        left -= size;
+        return size;
+    };
+    ProcessResult result = Process::run({ "wc", "-c" }, options);
+    ASSERT_EQUALS(0, result.status);
+    ASSERT_STRING_EQUALS("10000000\n", result.out);
+
+    // through and back
+    left = 10 * 1000 * 1000;
+    size_t total = 0;
+    options.on_out = [&](string_view chunk) { total += chunk.size(); };
+    result = Process::run({ "cat" }, options);
+    ASSERT_EQUALS(0, result.status);
+    ASSERT_EQUALS(10 * 1000 * 1000, total);
+
+    // a child not reading stdin: no SIGPIPE here, the producer just stops
+    size_t produced = 0;
+    ProcessOptions endless;
+    endless.on_stdin = [&](char* buff, size_t size) {
+        memset(buff, 'y', size);
+        produced += size;
+        return size;
+    };
+    result = Process::run({ "true" }, endless);
+    ASSERT_EQUALS(0, result.status);
+    ASSERT_TRUE(produced > 0);
+
+    // line by line through a filter
+    const char* input[] = { "alpha 1\n", "beta 2\n", "gamma 3\n" };
+    size_t at = 0;
+    ProcessOptions filter;
+    filter.on_stdin = [&](char* buff, size_t size) {
+        if (at == 3) return (size_t)0;
+        size_t len = min(size, strlen(input[at]));
+        memcpy(buff, input[at++], len);
+        return len;
+    };
+    vector<string> matched;
+    exec_lines({ "grep", "-v", "beta" }, [&](string_view line) {
+        if (reg_match("^[a-z]+ [0-9]$", string(line))) matched.emplace_back(line);
+    }, filter);
+    ASSERT_EQUALS(2, matched.size());
+    ASSERT_STRING_EQUALS("alpha 1", matched[0]);
+    ASSERT_STRING_EQUALS("gamma 3", matched[1]);
+}
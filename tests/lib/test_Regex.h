@@ -0,0 +1,92 @@
+#pragma once
+
+#include <thread>
+#include "../Test.h"
+#include "../../src/lib/utils.h"
+
+using namespace lib;
+
+TEST_CASE(test_lib_Regex, test_lib_Regex_match) {
+    Regex regex("(\\w+)@(\\w+)(\\.com)?");
+    ASSERT_STRING_EQUALS("(\\w+)@(\\w+)(\\.com)?", regex.getPattern());
+    ASSERT_TRUE(regex.match("mail: joe@example"));
+    ASSERT_FALSE(regex.match("no mail here"));
+
+    string str = "mail: joe@example.org";
+    vector<string_view> captures = { "untouched" };
+    ASSERT_FALSE(regex.match("nope", captures));
+    ASSERT_EQUALS(1, captures.size());
+    ASSERT_TRUE(regex.match(str, captures));
+    ASSERT_EQUALS(4, captures.size());
+    ASSERT_STRING_EQUALS("joe@example", string(captures[0]));
+    ASSERT_STRING_EQUALS("example", string(captures[2]));
+    ASSERT_TRUE(captures[3].empty());
+    ASSERT_TRUE(captures[1].data() == str.data() + 6); // a view, not a copy
+
+    vector<string> matches;
+    ASSERT_TRUE(regex.match(str, &matches));
+    ASSERT_EQUALS(4, matches.size());
+    ASSERT_STRING_EQUALS("joe", matches[1]);
+
+    ASSERT_THROWS_CONTAINS(Regex("(unclosed"), regex_error, "");
+}
+
+TEST_CASE(test_lib_Regex, test_lib_Regex_all) {
+    string log = "a=1, bb=22, ccc=333";
+    vector<string> keys;
+    vector<size_t> positions;
+    Regex pairs("(\\w+)=(\\d+)");
+    for (Regex::Match match: pairs.all(log)) {
+        keys.push_back(string(match[1]));
+        positions.push_back(match.position());
+        ASSERT_EQUALS(3, match.size());
+    }
+    ASSERT_TRUE(keys == vector<string>({ "a", "bb", "ccc" }));
+    ASSERT_TRUE(positions == vector<size_t>({ 0, 5, 12 }));
+
+    vector<string_view> values;
+    ASSERT_EQUALS(3, reg_match_all("(\\w+)=(\\d+)", log, &values, 2));
+    ASSERT_STRING_EQUALS("333", string(values[2]));
+    ASSERT_EQUALS(2, reg_match_all("\\d\\d", log));
+    ASSERT_EQUALS(0, reg_match_all("x", log, &values));
+    ASSERT_EQUALS(0, values.size());
+}
+
+// resizes the cache, restores the size on the destruction
+class test_lib_Regex_CacheSize {
+    size_t saved;
+public:
+    test_lib_Regex_CacheSize(size_t size): saved(Regex::getCacheSize()) {
+        Regex::setCacheSize(size);
+    }
+
+    ~test_lib_Regex_CacheSize() {
+        Regex::setCacheSize(saved);
+    }
+};
+
+// serial: the cache is shared with the reg_match() calls of the other groups
+TEST_CASE_SERIAL(test_lib_Regex, test_lib_Regex_cached) {
+    test_lib_Regex_CacheSize cache_size(2);
+    auto first = Regex::cached("a+");
+    ASSERT_TRUE(first == Regex::cached("a+"));
+    Regex::cached("b+");
+    Regex::cached("a+"); // the most recently used
+    Regex::cached("c+"); // evicts b+
+    ASSERT_EQUALS(2, Regex::getCacheCount());
+    ASSERT_TRUE(first == Regex::cached("a+"));
+    ASSERT_EQUALS(1, reg_match("b+", "abba"));
+
+    // shared by the threads
+    vector<thread> threads;
+    size_t matched[4] = {};
+    for (size_t t = 0; t < 4; t++) threads.emplace_back([&, t]() {
+        for (int i = 0; i < 100; i++) matched[t] += reg_match(i % 2 ? "\\d+" : "[a-z]+", "abc123");
+    });
+    for (thread& t: threads) t.join();
+    for (size_t t = 0; t < 4; t++) ASSERT_EQUALS(100, matched[t]);
+
+    Regex::setCacheSize(0);
+    ASSERT_EQUALS(0, Regex::getCacheCount());
+    ASSERT_FALSE(Regex::cached("a+") == Regex::cached("a+"));
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+#include "../Test.h"
+#include "../../src/lib/datef.h"
+
+using namespace lib;
+
+// switches the TZ of libc and TimeZone::local(), restores it on the destruction
+class test_lib_TimeZone_TZ {
+    string saved;
+    bool was_set;
+public:
+    test_lib_TimeZone_TZ(const char* tz) {
+        const char* old = getenv("TZ");
+        was_set = old;
+        if (old) saved = old;
+        set(tz);
+    }
+
+    ~test_lib_TimeZone_TZ() {
+        if (was_set) setenv("TZ", saved.c_str(), 1);
+        else unsetenv("TZ");
+        tzset();
+        TimeZone::reload();
+    }
+
+    void set(const char* tz) {
+        setenv("TZ", tz, 1);
+        tzset();
+        TimeZone::reload();
+    }
+};
+
+// serial: the TZ switches are process-wide (the other groups assume the default zone, and setenv() races getenv())
+TEST_CASE_SERIAL(test_lib_TimeZone, test_lib_TimeZone_vs_libc) {
+    vector<const char*> zones = {
+        "UTC", "Europe/Berlin", "America/New_York", "Australia/Sydney", "Asia/Kolkata", "America/Sao_Paulo",
+        "Pacific/Chatham", "Europe/Dublin", "EST5EDT,M3.2.0,M11.1.0", "<+0330>-3:30", "NZST-12NZDT,M9.5.0,M4.1.0/3",
+        "AAA3BBB,J60/2,300/-1"
+    };
+    test_lib_TimeZone_TZ tz("UTC");
+    RANDOM_SEED(19);
+    for (const char* name: zones) {
+        tz.set(name);
+        TimeZone zone(name);
+        ASSERT_STRING_EQUALS(name, zone.getName());
+        ASSERT_STRING_EQUALS(name, TimeZone::local().getName());
+
+        // 1901..2100 (the footer rule takes over after the last transition) and around the DST changes
+        vector<long> instants = { 0, 1651160700, 1679792400 - 1, 1679792400, 1698541200 - 1, 1698541200 };
+        for (int i = 0; i < 2000; i++) instants.push_back(RAND(-2145916800l, 4102444800l));
+        for (long sec: instants) {
+            if (sec < 0 && strchr(name, ',')) continue; // glibc applies the POSIX rules after 1970 only
+            time_t time = sec;
+            struct tm tm;
+            localtime_r(&time, &tm);
+            ASSERT_EQUALS(tm.tm_gmtoff, zone.offset(sec));
+            ASSERT_EQUALS(tm.tm_isdst > 0, zone.isDst(sec));
+            ASSERT_EQUALS(tm.tm_gmtoff, TimeZone::local().offset(sec));
+
+            // back from the local time, as mktime() except the repeated hours
+            tm.tm_isdst = -1;
+            long back = zone.fromLocal(zone.toLocal(sec));
+            ASSERT_TRUE(back == sec || zone.toLocal(back) == zone.toLocal(sec));
+            if (zone.offset(sec - 86400) == zone.offset(sec + 86400)) ASSERT_EQUALS(mktime(&tm), back);
+        }
+    }
+}
+
+TEST_CASE(test_lib_TimeZone, test_lib_TimeZone_rules) {
+    TimeZone utc;
+    ASSERT_EQUALS(0, utc.offset(1651160700));
+    ASSERT_FALSE(utc.isDst(1651160700));
+
+    TimeZone unknown;
+    ASSERT_FALSE(unknown.load("No/Such_Zone"));
+    ASSERT_STRING_EQUALS("UTC", unknown.getName());
+    ASSERT_EQUALS(0, unknown.offset(1651160700));
+
+    // southern hemisphere: the DST spans the new year
+    TimeZone sydney("AEST-10AEDT,M10.1.0,M4.1.0/3");
+    ASSERT_EQUALS(11 * 3600, sydney.offset(1641038400)); // 2022-01-01 12:00
+    ASSERT_EQUALS(10 * 3600, sydney.offset(1656676800)); // 2022-07-01 12:00
+
+    // the skipped hour is before the change, the repeated one is the later
+    TimeZone berlin("CET-1CEST,M3.5.0,M10.5.0/3");
+    long spring = days_from_civil(2023, 3, 26) * 86400;
+    ASSERT_EQUALS(spring + 2 * 3600 + 1800 - 3600, berlin.fromLocal(spring + 2 * 3600 + 1800));
+    long autumn = days_from_civil(2023, 10, 29) * 86400;
+    ASSERT_EQUALS(autumn + 2 * 3600 + 1800 - 3600, berlin.fromLocal(autumn + 2 * 3600 + 1800));
+}
+
+TEST_CASE_SERIAL(test_lib_TimeZone, test_lib_TimeZone_datef_date_parse) {
+    test_lib_TimeZone_TZ tz("Europe/Berlin");
+    ASSERT_STRING_EQUALS("2022-04-28 17:45:00.123", datef(1651160700123, "%Y-%m-%d %H:%M:%S", true, true));
+    ASSERT_STRING_EQUALS("2022-01-01", datefYMD(1640995200000, true));
+    ASSERT_LONG_EQUALS(1651160700123, date_parse("2022-04-28 17:45:00.123"));
+    long ms;
+    ASSERT_EQUALS(DATE_PARSE_OK, date_parse("2022-12-24 18:00", ms, true));
+    ASSERT_LONG_EQUALS(1671901200000, ms);
+
+    // the cached date of the same second follows a reload
+    tz.set("America/New_York");
+    ASSERT_STRING_EQUALS("2022-04-28 11:45:00.123", datef(1651160700123, "%Y-%m-%d %H:%M:%S", true, true));
+    ASSERT_LONG_EQUALS(1651160700123, date_parse("2022-04-28 11:45:00.123"));
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "../Test.h"
+#include "../../src/lib/Timer.h"
+
+using namespace lib;
+
+TEST_CASE(test_lib_Timer, test_lib_Timer_forced) {
+    Clock clock(1000);
+    Timer timer(clock, 100);
+    ASSERT_TRUE(timer.check());
+    ASSERT_FALSE(timer.check());
+
+    clock.delay(250); // catches up the missed tick
+    ASSERT_TRUE(timer.check());
+    ASSERT_TRUE(timer.check());
+    ASSERT_FALSE(timer.check());
+}
+
+TEST_CASE(test_lib_Timer, test_lib_Timer_not_forced) {
+    Clock clock(1000);
+    Timer timer(clock, 100, false);
+    ASSERT_FALSE(timer.isForced());
+    ASSERT_TRUE(timer.check());
+
+    clock.delay(250);
+    ASSERT_TRUE(timer.check());
+    ASSERT_FALSE(timer.check());
+
+    timer.off();
+    clock.delay(1000);
+    ASSERT_FALSE(timer.check());
+}
+
+TEST_CASE(test_lib_Timer, test_lib_Timer_nanos) {
+    Clock clock(1000);
+    Timer timer(clock);
+    timer.setIntervalNanos(250000);
+    ASSERT_EQUALS(timer.getInterval(), 0ul);
+    ASSERT_EQUALS(timer.getIntervalNanos(), 250000ull);
+    ASSERT_TRUE(timer.check());
+
+    clock.delayNanos(200000);
+    ASSERT_FALSE(timer.check());
+    clock.delayNanos(50000);
+    ASSERT_TRUE(timer.check());
+
+    timer.setInterval(2);
+    ASSERT_EQUALS(timer.getIntervalNanos(), 2000000ull);
+}
+
+TEST_CASE(test_lib_Timer, test_lib_Timer_null_clock) {
+    Clock clock(CLK_NULL);
+    Timer timer(clock, 100);
+    ASSERT_FALSE(timer.check());
+    timer.setInterval(200);
+    ASSERT_EQUALS(timer.getInterval(), 100ul);
+    ASSERT_TRUE(&timer.getClock() == &clock);
+}
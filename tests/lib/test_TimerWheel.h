@@ -0,0 +1,149 @@
+#pragma once
+
+#include "../Test.h"
+#include "../../src/lib/TimerWheel.h"
+
+using namespace lib;
+
+TEST_CASE(test_lib_TimerWheel, test_lib_TimerWheel_one_shot) {
+    Clock clock(1000);
+    TimerWheel wheel(clock);
+    vector<unsigned long> fired;
+    wheel.schedule(100, [&]() { fired.push_back(clock.now()); });
+    wheel.schedule(300, [&]() { fired.push_back(clock.now()); });
+    ASSERT_EQUALS(wheel.size(), 2ul);
+
+    clock.delay(99);
+    ASSERT_EQUALS(wheel.advance(), 0ul);
+    clock.delay(1);
+    ASSERT_EQUALS(wheel.advance(), 1ul);
+    ASSERT_EQUALS(wheel.advance(), 0ul);
+    ASSERT_EQUALS(wheel.size(), 1ul);
+
+    clock.delay(1000);
+    ASSERT_EQUALS(wheel.advance(), 1ul);
+    ASSERT_EQUALS(wheel.size(), 0ul);
+    ASSERT_EQUALS(fired.size(), 2ul);
+    ASSERT_EQUALS(fired[0], 1100ul);
+    ASSERT_EQUALS(fired[1], 2100ul);
+}
+
+TEST_CASE(test_lib_TimerWheel, test_lib_TimerWheel_cancel) {
+    Clock clock(1000);
+    TimerWheel wheel(clock);
+    int fired = 0;
+    TimerWheel::Id a = wheel.schedule(10, [&]() { fired++; });
+    TimerWheel::Id b = wheel.schedule(10, [&]() { fired += 10; });
+    ASSERT_TRUE(wheel.isScheduled(a));
+    ASSERT_TRUE(wheel.cancel(a));
+    ASSERT_FALSE(wheel.cancel(a));
+    ASSERT_FALSE(wheel.isScheduled(a));
+
+    // the freed entry is reused with a new id
+    TimerWheel::Id c = wheel.schedule(20, [&]() { fired += 100; }, true);
+    ASSERT_TRUE(a != c);
+    ASSERT_FALSE(wheel.isScheduled(a));
+
+    clock.delay(10);
+    wheel.advance();
+    ASSERT_EQUALS(fired, 10);
+    ASSERT_FALSE(wheel.isScheduled(b));
+
+    // cancels itself in its callback
+    TimerWheel::Id d = 0;
+    d = wheel.schedule(5, [&]() { fired += 1000; ASSERT_TRUE(wheel.cancel(d)); }, true);
+    clock.delay(20);
+    wheel.advance();
+    ASSERT_EQUALS(fired, 1110);
+    ASSERT_FALSE(wheel.isScheduled(d));
+    ASSERT_TRUE(wheel.isScheduled(c));
+    ASSERT_EQUALS(wheel.size(), 1ul);
+}
+
+TEST_CASE(test_lib_TimerWheel, test_lib_TimerWheel_repeat) {
+    Clock clock(1000);
+    TimerWheel wheel(clock);
+    Timer timer(clock, 100);
+    timer.check(); // the Timer fires at start, the wheel an interval later
+    int forced = 0, lazy = 0, checked = 0;
+    wheel.schedule(100, [&]() { forced++; }, true);
+    wheel.schedule(100, [&]() { lazy++; }, true, false);
+
+    clock.delay(350); // forced catches up the missed ticks as the Timer does
+    ASSERT_EQUALS(wheel.advance(), 4ul);
+    while (timer.check()) checked++;
+    ASSERT_EQUALS(forced, 3);
+    ASSERT_EQUALS(checked, 3);
+    ASSERT_EQUALS(lazy, 1);
+
+    clock.delay(50); // forced: 1400, lazy: 1450
+    ASSERT_EQUALS(wheel.advance(), 1ul);
+    ASSERT_EQUALS(forced, 4);
+    clock.delay(50);
+    ASSERT_EQUALS(wheel.advance(), 1ul);
+    ASSERT_EQUALS(lazy, 2);
+}
+
+TEST_CASE(test_lib_TimerWheel, test_lib_TimerWheel_levels) {
+    Clock clock(1000);
+    TimerWheel wheel(clock);
+    vector<unsigned long> dues = { 255, 256, 257, 65535, 65536, 70000, 16777216, 20000000, 5000000000ul };
+    vector<unsigned long> fired;
+    for (unsigned long due: dues) wheel.schedule(due, [&fired, &clock]() { fired.push_back(clock.now()); });
+
+    // tick by tick to the 70000 so the early ones would be seen
+    for (int i = 0; i < 70000; i++) {
+        clock.delay(1);
+        wheel.advance();
+    }
+    ASSERT_EQUALS(fired.size(), 6ul);
+    for (size_t i = 0; i < fired.size(); i++) ASSERT_EQUALS(fired[i], 1000 + dues[i]);
+
+    // and jumps for the rest
+    clock.set(1000 + 16777215);
+    ASSERT_EQUALS(wheel.advance(), 0ul);
+    clock.delay(1);
+    ASSERT_EQUALS(wheel.advance(), 1ul);
+    clock.set(1000 + 4999999999ul);
+    ASSERT_EQUALS(wheel.advance(), 1ul);
+    clock.delay(1);
+    ASSERT_EQUALS(wheel.advance(), 1ul);
+    ASSERT_EQUALS(fired.back(), 1000 + 5000000000ul);
+    ASSERT_EQUALS(wheel.size(), 0ul);
+}
+
+TEST_CASE(test_lib_TimerWheel, test_lib_TimerWheel_tick) {
+    Clock clock(1000);
+    TimerWheel wheel(clock, 10);
+    int fired = 0;
+    wheel.schedule(15, [&]() { fired++; }); // never early: on the tick of 1020
+    wheel.schedule(0, [&]() { fired += 10; });
+    ASSERT_TRUE(&wheel.getClock() == &clock);
+    ASSERT_EQUALS(wheel.advance(), 1ul);
+    clock.delay(15);
+    ASSERT_EQUALS(wheel.advance(), 0ul);
+    clock.delay(5);
+    ASSERT_EQUALS(wheel.advance(), 1ul);
+    ASSERT_EQUALS(fired, 11);
+
+    Clock null(CLK_NULL);
+    TimerWheel nowheel(null);
+    ASSERT_EQUALS(nowheel.advance(), 0ul);
+}
+
+TEST_CASE(test_lib_TimerWheel, test_lib_TimerWheel_nextDue) {
+    Clock clock(1000);
+    TimerWheel wheel(clock);
+    ASSERT_EQUALS(wheel.nextDue(), CLK_NULL);
+    TimerWheel::Id far = wheel.schedule(100000, []() {});
+    ASSERT_EQUALS(wheel.nextDue(), 65536ul); // the cascade of the level 1
+    wheel.schedule(200, []() {});
+    ASSERT_EQUALS(wheel.nextDue(), 1200ul);
+    clock.set(1200);
+    wheel.advance();
+    wheel.cancel(far);
+    wheel.schedule(300, []() {}); // due at 1500
+    ASSERT_EQUALS(wheel.nextDue(), 1280ul); // the cascade of the level 1
+    wheel.schedule(0, []() {});
+    ASSERT_EQUALS(wheel.nextDue(), 1201ul);
+}
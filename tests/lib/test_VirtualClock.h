@@ -0,0 +1,115 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include "../Test.h"
+#include "../../src/lib/VirtualClock.h"
+#include "../../src/lib/Timer.h"
+
+using namespace lib;
+
+TEST_CASE(test_lib_VirtualClock, test_lib_VirtualClock_single_thread) {
+    VirtualClock clock(1000, 1);
+    clock.delay(500);
+    ASSERT_EQUALS(clock.now(), 1500ul);
+    clock.delayNanos(1500);
+    ASSERT_EQUALS(clock.nanos(), 1500001500ull);
+    clock.set(2000);
+    ASSERT_EQUALS(clock.nanos(), 2000000000ull);
+
+    // runs the Timer as any Clock
+    Timer timer(clock, 100);
+    ASSERT_TRUE(timer.check());
+    clock.delay(100);
+    ASSERT_TRUE(timer.check());
+    ASSERT_FALSE(timer.check());
+
+    ASSERT_THROWS_CONTAINS(VirtualClock(CLK_REAL), runtime_error, "Virtual clock can not start at real time");
+}
+
+TEST_CASE(test_lib_VirtualClock, test_lib_VirtualClock_auto_advance) {
+    VirtualClock clock(1000);
+    mutex lock;
+    vector<vector<unsigned long>> times(3);
+    vector<thread> threads;
+    for (size_t i = 0; i < times.size(); i++) clock.join(); // all before the threads start, so no one runs ahead
+    for (size_t i = 0; i < times.size(); i++) {
+        threads.emplace_back([&clock, &lock, &times, i]() {
+            for (int k = 0; k < 5; k++) {
+                clock.delay(60000 * (i + 1)); // minutes
+                lock_guard<mutex> guard(lock);
+                times[i].push_back(clock.now());
+            }
+            clock.leave();
+        });
+    }
+    for (thread& t: threads) t.join();
+
+    for (size_t i = 0; i < times.size(); i++) {
+        ASSERT_EQUALS(times[i].size(), 5ul);
+        for (size_t k = 0; k < 5; k++) ASSERT_EQUALS(times[i][k], 1000 + 60000 * (i + 1) * (k + 1));
+    }
+    ASSERT_EQUALS(clock.now(), 1000ul + 60000 * 3 * 5);
+}
+
+TEST_CASE(test_lib_VirtualClock, test_lib_VirtualClock_same_instant) {
+    // the threads waking together resume one by one in the order of their delays, every run
+    VirtualClock clock(1000, 0, false);
+    vector<size_t> order;
+    vector<thread> threads;
+    for (size_t i = 0; i < 4; i++) {
+        clock.join();
+        threads.emplace_back([&clock, &order, i]() {
+            for (int k = 0; k < 50; k++) {
+                clock.delay(10);
+                order.push_back(i); // no lock: only one of them runs at a time
+                this_thread::yield();
+            }
+            clock.leave();
+        });
+        clock.waitBlocked(i + 1); // the first delays in the order of the threads
+    }
+    clock.advanceTo(1500);
+    for (thread& t: threads) t.join();
+    ASSERT_EQUALS(order.size(), 200ul);
+    for (size_t k = 0; k < order.size(); k++) ASSERT_EQUALS(order[k], k % 4);
+    ASSERT_EQUALS(clock.now(), 1500ul);
+    ASSERT_FALSE(clock.isReal());
+}
+
+TEST_CASE(test_lib_VirtualClock, test_lib_VirtualClock_controller) {
+    VirtualClock clock(1000, 0, false);
+    ASSERT_FALSE(clock.advance());
+
+    unsigned long woken = 0;
+    thread sleeper([&]() {
+        clock.delay(100);
+        woken = clock.now();
+    });
+    clock.waitBlocked(1);
+    ASSERT_EQUALS(clock.now(), 1000ul);
+    ASSERT_TRUE(clock.advance());
+    sleeper.join();
+    ASSERT_EQUALS(woken, 1100ul);
+
+    // steps through the wakeups of the participant
+    vector<unsigned long> ticks;
+    clock.join();
+    thread ticker([&]() {
+        VirtualClock::Thread participant(clock);
+        clock.leave(); // the guard took over
+        for (int i = 0; i < 10; i++) {
+            clock.delay(10);
+            ticks.push_back(clock.now());
+        }
+    });
+    clock.advanceTo(1155);
+    ASSERT_EQUALS(ticks.size(), 5ul);
+    ASSERT_EQUALS(ticks.back(), 1150ul);
+    ASSERT_EQUALS(clock.now(), 1155ul);
+    clock.advanceBy(1000);
+    ticker.join();
+    ASSERT_EQUALS(ticks.size(), 10ul);
+    ASSERT_EQUALS(ticks.back(), 1200ul);
+    ASSERT_EQUALS(clock.now(), 2155ul);
+}
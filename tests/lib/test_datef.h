@@ -0,0 +1,83 @@
+#pragma once
+
+#include <ctime>
+#include "../Test.h"
+#include "../../src/lib/datef.h"
+
+using namespace lib;
+
+// what the old datef() did: gmtime_r/localtime_r, strftime, sprintf
+inline string test_lib_datef_strftime(long ms, const char* fmt, bool millis = true, bool local = false) {
+    long sec = ms >= 0 ? ms / 1000 : (ms - 999) / 1000;
+    time_t time = sec;
+    struct tm tm;
+    if (local) localtime_r(&time, &tm);
+    else gmtime_r(&time, &tm);
+    char buff[256];
+    size_t len = strftime(buff, sizeof(buff), fmt, &tm);
+    string date(buff, len);
+    if (millis) date += concat(".", string(3 - to_string(ms - sec * 1000).size(), '0'), ms - sec * 1000);
+    return date;
+}
+
+TEST_CASE(test_lib_datef, test_lib_datef_formats) {
+    vector<const char*> formats = {
+        "%Y-%m-%d %H:%M:%S", "%F %T", "%Y%m%d", "%d/%m/%y %e %j %%", "[%H:%M]", "", "no directives", "%a %b %Z %Y" 
+    };
+    vector<long> stamps = { 
+        1651160700123, 1, 999, 86399999, 951782400000 /* 2000-02-29 */, 4102444799999, 
+        -1, -86400001, 253402300799999 /* 9999-12-31 */, 253402300800000, -62135596800000 /* 0001-01-01 */
+    };
+    RANDOM_SEED(42);
+    for (long i = 0; i < 200; i++) stamps.push_back(RAND(0l, 4102444800000l));
+    for (const char* fmt: formats) {
+        for (long ms: stamps) {
+            ASSERT_STRING_EQUALS(test_lib_datef_strftime(ms, fmt), datef(ms, fmt));
+            ASSERT_STRING_EQUALS(test_lib_datef_strftime(ms, fmt, false), datef(ms, fmt, false));
+        }
+    }
+    ASSERT_STRING_EQUALS("2022-04-28 15:45:00.123", datef(1651160700123));
+    ASSERT_STRING_EQUALS("2022-04-28", datefYMD(1651160700123));
+    ASSERT_STRING_EQUALS(test_lib_datef_strftime(1651160700123, "%Y-%m-%d %H:%M:%S", true, true), datef(1651160700123, "%Y-%m-%d %H:%M:%S", true, true));
+    ASSERT_STRING_EQUALS(test_lib_datef_strftime(1651160700123, "%Y-%m-%d", false, true), datefYMD(1651160700123, true));
+    ASSERT_EQUALS(datef().size(), 23ul);
+
+    // interleaved formats, more than the cached ones too
+    for (long ms = 1651160700123; ms < 1651160700123 + 5 * 86400000; ms += 3600000) {
+        ASSERT_STRING_EQUALS(test_lib_datef_strftime(ms, "%Y-%m-%d %H:%M:%S"), datef(ms));
+        ASSERT_STRING_EQUALS(test_lib_datef_strftime(ms, "%Y-%m-%d", false), datefYMD(ms));
+        for (const char* fmt: formats) ASSERT_STRING_EQUALS(test_lib_datef_strftime(ms, fmt, false), datef(ms, fmt, false));
+    }
+
+    // long formats are not truncated any more
+    string longfmt = "%Y-%m-%d %H:%M:%S and a long text after the date to not fit in the old 26 bytes";
+    ASSERT_STRING_EQUALS(test_lib_datef_strftime(1651160700123, longfmt.c_str()), datef(1651160700123, longfmt.c_str()));
+}
+
+TEST_CASE(test_lib_datef, test_lib_DateFormat) {
+    constexpr DateFormat::Ops ops = DateFormat::compile("%F %T.");
+    static_assert(ops.count == 4 && ops.ops[0].type == 'F' && ops.ops[3].len == 1 && !ops.strftime, "compiled at compile time");
+    static_assert(DateFormat::compile("%A").strftime, "falls back to strftime");
+
+    DateFormat format;
+    char buff[32];
+    ASSERT_EQUALS(format.format(1651160700123, buff, sizeof(buff)), 23ul);
+    ASSERT_STRING_EQUALS("2022-04-28 15:45:00.123", buff);
+    ASSERT_EQUALS(format.format(1651160700999, buff, sizeof(buff)), 23ul); // the same second
+    ASSERT_STRING_EQUALS("2022-04-28 15:45:00.999", buff);
+    ASSERT_EQUALS(format.format(1651160701000, buff, 12), 23ul); // truncated
+    ASSERT_STRING_EQUALS("2022-04-28 ", buff);
+    ASSERT_EQUALS(format.format(1651160701000, buff, 0), 23ul);
+    ASSERT_EQUALS(format.format(1651160701000, buff, 22), 23ul);
+    ASSERT_STRING_EQUALS("2022-04-28 15:45:01.0", buff);
+
+    // batch into fixed width records
+    vector<long> column = { 1651160700123, 1651160700124, 1651160760000 };
+    vector<char> records(column.size() * 24);
+    ASSERT_EQUALS(format.format(column.data(), column.size(), records.data(), 24), 23ul);
+    ASSERT_STRING_EQUALS("2022-04-28 15:45:00.124", &records[24]);
+    ASSERT_STRING_EQUALS("2022-04-28 15:46:00.000", &records[48]);
+    vector<string> dates = DateFormat("%H:%M:%S", false).format(column);
+    ASSERT_EQUALS(dates.size(), 3ul);
+    ASSERT_STRING_EQUALS("15:46:00", dates[2]);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include "../Test.h"
+#include "../../src/lib/utils.h"
+
+using namespace lib;
+
+struct test_lib_format_Point {
+    int x, y;
+};
+
+inline ostream& operator<<(ostream& out, const test_lib_format_Point& point) {
+    return out << "(" << point.x << ", " << point.y << ")";
+}
+
+// what join() did
+template <typename... T>
+inline string test_lib_format_ostream(const string& glue, T... args) {
+    ostringstream oss;
+    ((oss << args << glue), ...);
+    return join_remove_last_glue(oss, glue);
+}
+
+TEST_CASE(test_lib_format, test_lib_format_vs_ostream) {
+    string str = "string";
+    string_view view = "view";
+    const char* chars = "chars";
+    char buff[16] = "buff";
+    test_lib_format_Point point = { 1, -2 };
+    ASSERT_STRING_EQUALS(
+        test_lib_format_ostream(",", 0, -1, INT_MIN, LONG_MAX, ULONG_MAX, (short)-5, (unsigned short)7, 'c', (unsigned char)'u', true, false),
+        join(",", 0, -1, INT_MIN, LONG_MAX, ULONG_MAX, (short)-5, (unsigned short)7, 'c', (unsigned char)'u', true, false));
+    ASSERT_STRING_EQUALS(test_lib_format_ostream("|", str, view, chars, buff, "literal", point, ""), join("|", str, view, chars, buff, "literal", point, ""));
+
+    vector<double> doubles = {
+        0.0, -0.0, 1.0, 0.1, -2.5, 1e20, 1e-5, 123456789.0, 123456.5, 3.14159265358979, 1e100, 5e-324,
+        numeric_limits<double>::infinity(), -numeric_limits<double>::infinity(), numeric_limits<double>::max()
+    };
+    RANDOM_SEED(22);
+    for (int i = 0; i < 1000; i++) {
+        double mantissa = RANDD(-1e6, 1e6);
+        doubles.push_back(mantissa * pow(10.0, RAND(-12, 12)));
+    }
+    for (double value: doubles) {
+        ASSERT_STRING_EQUALS(test_lib_format_ostream("", value), concat(value));
+        ASSERT_STRING_EQUALS(test_lib_format_ostream("", (float)value), concat((float)value));
+    }
+    ASSERT_STRING_EQUALS(test_lib_format_ostream("", NAN), concat(NAN));
+}
+
+TEST_CASE(test_lib_format, test_lib_format_append) {
+    string out = "log: ";
+    str_append(out, "x=", 42, ", y=", 0.5);
+    ASSERT_STRING_EQUALS("log: x=42, y=0.5", out);
+    str_append_join(out, " ", "", 1, "two");
+    ASSERT_STRING_EQUALS("log: x=42, y=0.5 1 two", out);
+    ASSERT_STRING_EQUALS("", join(","));
+    ASSERT_STRING_EQUALS("", join(",", vector<int>()));
+    ASSERT_STRING_EQUALS("a, b", join(", ", vector<string>({ "a", "b" })));
+    const char* null = nullptr;
+    ASSERT_STRING_EQUALS("ab", concat("a", null, "b"));
+
+    // the sinks get the thread-local buffer
+    string sunk;
+    const char* data = nullptr;
+    str_sink([&](string_view str) { sunk = str; data = str.data(); }, "id:", 7);
+    ASSERT_STRING_EQUALS("id:7", sunk);
+    str_sink([&](string_view str) { ASSERT_TRUE(str.data() == data); }, "reused");
+    ostringstream stream;
+    str_write(stream, "a", 1, 'b') << "!";
+    ASSERT_STRING_EQUALS("a1b!", stream.str());
+
+    ASSERT_THROWS_CONTAINS(throw ERROR("code: ", 404), runtime_error, "[ERROR] code: 404");
+}
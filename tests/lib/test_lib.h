@@ -7,7 +7,7 @@ const int MAJOR = LIB_VERSION_MAJOR;
 const int MINOR = LIB_VERSION_MINOR;
 const int PATCH = LIB_VERSION_PATCH;
 
-void test_lib_version_check_min() {
+TEST_CASE(test_lib, test_lib_version_check_min) {
     ASSERT_TRUE(verion_check_min(MAJOR, MINOR, PATCH));
     ASSERT_TRUE(verion_check_min(MAJOR, MINOR));
     ASSERT_TRUE(verion_check_min(MAJOR));
@@ -18,7 +18,7 @@ void test_lib_version_check_min() {
 }
 
 
-void test_lib_version_check_max() {
+TEST_CASE(test_lib, test_lib_version_check_max) {
     ASSERT_TRUE(verion_check_max(MAJOR, MINOR, PATCH));
     ASSERT_TRUE(verion_check_max(MAJOR, MINOR));
     ASSERT_TRUE(verion_check_max(MAJOR));
@@ -28,7 +28,7 @@ void test_lib_version_check_max() {
     ASSERT_FALSE(verion_check_max(MAJOR - 1));
 }
 
-void test_lib_version_check() {
+TEST_CASE(test_lib, test_lib_version_check) {
     ASSERT_TRUE(verion_check(MAJOR, MINOR, PATCH));
     ASSERT_TRUE(verion_check(MAJOR, MINOR));
     ASSERT_TRUE(verion_check(MAJOR));
@@ -39,14 +39,14 @@ void test_lib_version_check() {
     ASSERT_FALSE(verion_check(MAJOR + 1));
 }
 
-void test_lib_str_dirname() {
+TEST_CASE(test_lib, test_lib_str_dirname) {
     const char* filename = "/path/to/file.txt";
     std::string expected_dirname = "/path/to";
     std::string dirname = str_dirname(filename);
     ASSERT_STRING_EQUALS(dirname, expected_dirname);
 }
 
-void test_lib_join_remove_last_glue() {
+TEST_CASE(test_lib, test_lib_join_remove_last_glue) {
     ostringstream oss;
     oss << "apple" << "," << "banana" << "," << "pear" << ",";
     string expected_str = "apple,banana,pear";
@@ -54,7 +54,7 @@ void test_lib_join_remove_last_glue() {
     ASSERT_STRING_EQUALS(result, expected_str);
 }
 
-void test_lib_join() {
+TEST_CASE(test_lib, test_lib_join) {
     std::vector<int> vec = {1, 2, 3};
     std::string result = join("-", "a", "b", "c");
     ASSERT_STRING_EQUALS(result, "a-b-c");
@@ -63,13 +63,13 @@ void test_lib_join() {
     ASSERT_STRING_EQUALS(result, "1:2:3");
 }
 
-void test_lib_concat() {
+TEST_CASE(test_lib, test_lib_concat) {
     std::string result = concat("Hello", " world", "!");
     std::string expected = "Hello world!";
     ASSERT_STRING_EQUALS(result, expected);
 }
 
-void test_lib_quote() {
+TEST_CASE(test_lib, test_lib_quote) {
     std::string str = "hello";
     std::string expected = "\"hello\"";
 
@@ -77,7 +77,7 @@ void test_lib_quote() {
 
     ASSERT_STRING_EQUALS(quoted, expected);
 }
-void test_lib_reg_match() {
+TEST_CASE(test_lib, test_lib_reg_match) {
     string str = "This is a test string with some numbers 123 and some special characters !@#$%^&*";
     vector<string> matches;
     
@@ -98,7 +98,7 @@ void test_lib_reg_match() {
     ASSERT_STRING_EQUALS(matches[2], "is");
 }
 
-void test_lib_reg_match_alphabets() {
+TEST_CASE(test_lib, test_lib_reg_match_alphabets) {
     std::string str = "Thisisateststringwithsomenumbersandallsorts of special characters!@#$%^&*()_+";
     std::vector<std::string> matches;
 
@@ -116,7 +116,7 @@ void test_lib_reg_match_alphabets() {
     ASSERT_EQUALS(matches.size(), 1);
 }
 
-void test_lib_date_parse() {
+TEST_CASE(test_lib, test_lib_date_parse) {
     string date_string = "2022-04-28 15:45:00.123";
     unsigned long expected_timestamp = 1651160700123;
 
@@ -125,14 +125,103 @@ void test_lib_date_parse() {
     ASSERT_LONG_EQUALS(timestamp, expected_timestamp);
 }
 
-void test_lib_exec() {
+TEST_CASE(test_lib, test_lib_date_parse_utc) {
+    long ms = 0;
+    ASSERT_EQUALS(DATE_PARSE_OK, date_parse("2022-04-28 15:45:00.123", ms));
+    ASSERT_LONG_EQUALS(1651160700123, ms);
+    ASSERT_EQUALS(DATE_PARSE_OK, date_parse("2022-04-28T15:45:00.1239Z", ms));
+    ASSERT_LONG_EQUALS(1651160700123, ms);
+    ASSERT_EQUALS(DATE_PARSE_OK, date_parse("2022-04-28T17:45:00,5+02:00", ms));
+    ASSERT_LONG_EQUALS(1651160700500, ms);
+    ASSERT_EQUALS(DATE_PARSE_OK, date_parse("2022-04-28 10:15-0530", ms));
+    ASSERT_LONG_EQUALS(1651160700000, ms);
+    ASSERT_EQUALS(DATE_PARSE_OK, date_parse("2022-04", ms));
+    ASSERT_LONG_EQUALS(1648771200000, ms);
+    ASSERT_EQUALS(DATE_PARSE_OK, date_parse("1969-12-31 23:59:59.999", ms));
+    ASSERT_LONG_EQUALS(-1, ms);
+
+    // the same as timegm() on every day of 1900..2100
+    RANDOM_SEED(18);
+    for (int i = 0; i < 1000; i++) {
+        struct tm time_info = {};
+        time_info.tm_year = RAND(0, 200);
+        time_info.tm_mon = RAND(0, 11);
+        time_info.tm_mday = RAND(1, 28);
+        time_info.tm_hour = RAND(0, 23);
+        time_info.tm_min = RAND(0, 59);
+        time_info.tm_sec = RAND(0, 59);
+        char buff[32];
+        strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", &time_info);
+        ASSERT_EQUALS(DATE_PARSE_OK, date_parse(buff, ms));
+        ASSERT_LONG_EQUALS(timegm(&time_info) * 1000, ms);
+    }
+}
+
+TEST_CASE(test_lib, test_lib_date_parse_local) {
+    long ms = 0;
+    const char* dates[] = { "2022-01-15 08:30:00", "2022-07-15 08:30:00", "1999-12-31 23:59:59" };
+    for (const char* date: dates) {
+        struct tm time_info = {};
+        strptime(date, "%Y-%m-%d %H:%M:%S", &time_info);
+        time_info.tm_isdst = -1;
+        ASSERT_EQUALS(DATE_PARSE_OK, date_parse(date, ms, true));
+        ASSERT_LONG_EQUALS(mktime(&time_info) * 1000, ms);
+        ASSERT_LONG_EQUALS(mktime(&time_info) * 1000, date_parse(string(date)));
+    }
+    // an explicit zone wins
+    ASSERT_EQUALS(DATE_PARSE_OK, date_parse("2022-04-28 15:45:00Z", ms, true));
+    ASSERT_LONG_EQUALS(1651160700000, ms);
+}
+
+TEST_CASE(test_lib, test_lib_date_parse_errors) {
+    long ms = 42;
+    ASSERT_EQUALS(DATE_PARSE_SYNTAX_ERROR, date_parse("", ms));
+    ASSERT_EQUALS(DATE_PARSE_SYNTAX_ERROR, date_parse("22-04-28", ms));
+    ASSERT_EQUALS(DATE_PARSE_SYNTAX_ERROR, date_parse("2022-4-28", ms));
+    ASSERT_EQUALS(DATE_PARSE_SYNTAX_ERROR, date_parse("2022-04-28 15:45:00.", ms));
+    ASSERT_EQUALS(DATE_PARSE_SYNTAX_ERROR, date_parse("2022-04-28 15:45:00 ", ms));
+    ASSERT_EQUALS(DATE_PARSE_SYNTAX_ERROR, date_parse("2022-04-28 15:45:00+1", ms));
+    ASSERT_EQUALS(DATE_PARSE_SYNTAX_ERROR, date_parse("2022-04-28 15:45:00+02:", ms));
+    ASSERT_EQUALS(DATE_PARSE_SYNTAX_ERROR, date_parse("2022-04-28 15:45:00+02:3", ms));
+    ASSERT_EQUALS(DATE_PARSE_RANGE_ERROR, date_parse("2022-13-01", ms));
+    ASSERT_EQUALS(DATE_PARSE_RANGE_ERROR, date_parse("2022-02-29", ms));
+    ASSERT_EQUALS(DATE_PARSE_RANGE_ERROR, date_parse("2022-04-28 24:00", ms));
+    ASSERT_EQUALS(DATE_PARSE_OK, date_parse("2024-02-29", ms));
+    ASSERT_THROWS_CONTAINS(date_parse(string("2022-04-x8")), runtime_error, "Invalid date: 2022-04-x8");
+    ASSERT_THROWS_CONTAINS(date_parse(string("22")), runtime_error, "Invalid date: 22");
+    ASSERT_LONG_EQUALS(0, date_parse(string()));
+
+    // the legacy overload still reads the fixed positions with any separators, rolling over as mktime() did
+    ASSERT_LONG_EQUALS(date_parse(string("2022-04-28 15:45:00.123")), date_parse(string("2022/04/28 15:45:00.123")));
+    ASSERT_LONG_EQUALS(date_parse(string("2022-04-28 15:45:00")), date_parse(string("2022.04.28_15h45m00s")));
+    const char* rolled[][2] = { { "2022-02-30", "2022-03-02" }, { "2022-13-01", "2023-01-01" }, { "2022-04-28 24:00", "2022-04-29 00:00" } };
+    for (auto& dates: rolled) ASSERT_LONG_EQUALS(date_parse(string(dates[1])), date_parse(string(dates[0])));
+}
+
+TEST_CASE(test_lib, test_lib_date_parse_batch) {
+    string_view dates[] = { "2022-04-28 15:45:00.123", "nope", "1970-01-01" };
+    long out[3];
+    ASSERT_EQUALS(1, date_parse(dates, 3, out));
+    ASSERT_LONG_EQUALS(1651160700123, out[0]);
+    ASSERT_TRUE(out[1] == DATE_INVALID);
+    ASSERT_LONG_EQUALS(0, out[2]);
+
+    vector<long> parsed;
+    ASSERT_EQUALS(1, date_parse_lines("2022-04-28 15:45:00.123\r\n\n2022-04-28T15:45:01Z\nbad\n1970-01-02", parsed));
+    ASSERT_EQUALS(4, parsed.size());
+    ASSERT_LONG_EQUALS(1651160701000, parsed[1]);
+    ASSERT_TRUE(parsed[2] == DATE_INVALID);
+    ASSERT_LONG_EQUALS(MS_PER_DAY, parsed[3]);
+}
+
+TEST_CASE(test_lib, test_lib_exec) {
     string output;
     int status = exec("echo 'Hello, world!'", output);
     ASSERT_EQUALS(status, 0);
     ASSERT_MATCH("Hello, world!", output);
 }
 
-void test_lib_explode() {
+TEST_CASE(test_lib, test_lib_explode) {
     string str = "apple,banana,orange";
     vector<string> tokens = explode(',', str);
     vector<string> expected_tokens = {"apple", "banana", "orange"};
@@ -154,7 +243,7 @@ void test_lib_explode() {
     ASSERT_TRUE(tokens == expected_tokens);
 }
 
-void test_lib_random_macros() {
+TEST_CASE(test_lib, test_lib_random_macros) {
     // Set random seed to a fixed value for reproducibility
     RANDOM_SEED(42);
 
@@ -179,23 +268,3 @@ void test_lib_random_macros() {
     bool randb_val = RANDB();
     ASSERT_TRUE(randb_val == 0 || randb_val == 1);
 }
-
-
-
-void test_lib() {
-    TEST(test_lib_version_check_min);
-    TEST(test_lib_version_check_max);
-    TEST(test_lib_version_check);
-    TEST(test_lib_Clock);
-    TEST(test_lib_str_dirname);
-    TEST(test_lib_join_remove_last_glue);
-    TEST(test_lib_join);
-    TEST(test_lib_concat);
-    TEST(test_lib_quote);
-    TEST(test_lib_reg_match);
-    TEST(test_lib_reg_match_alphabets);
-    TEST(test_lib_date_parse);
-    TEST(test_lib_exec);
-    TEST(test_lib_explode);
-    TEST(test_lib_random_macros);
-}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <sstream>
+#include "../Test.h"
+#include "../../src/lib/utils.h"
+
+using namespace lib;
+
+// what explode() did
+inline vector<string> test_lib_split_getline(char delimiter, const string& str) {
+    vector<string> tokens;
+    stringstream ss(str);
+    string token;
+    while (getline(ss, token, delimiter)) tokens.push_back(token);
+    return tokens;
+}
+
+inline vector<string> test_lib_split_strings(string_view str, string_view delimiter, split_policy policy) {
+    vector<string> tokens;
+    for (string_view token: split(str, delimiter, policy)) tokens.emplace_back(token);
+    return tokens;
+}
+
+TEST_CASE(test_lib_split, test_lib_split_policies) {
+    ASSERT_TRUE(test_lib_split_strings("a,,b,", ",", SPLIT_KEEP_EMPTY) == vector<string>({ "a", "", "b", "" }));
+    ASSERT_TRUE(test_lib_split_strings("a,,b,", ",", SPLIT_DROP_TRAILING) == vector<string>({ "a", "", "b" }));
+    ASSERT_TRUE(test_lib_split_strings(",a,,b,", ",", SPLIT_SKIP_EMPTY) == vector<string>({ "a", "b" }));
+    ASSERT_TRUE(test_lib_split_strings("", ",", SPLIT_KEEP_EMPTY) == vector<string>({ "" }));
+    ASSERT_TRUE(test_lib_split_strings("", ",", SPLIT_DROP_TRAILING).empty());
+    ASSERT_TRUE(test_lib_split_strings(",,", ",", SPLIT_SKIP_EMPTY).empty());
+    ASSERT_TRUE(test_lib_split_strings("abc", "", SPLIT_KEEP_EMPTY) == vector<string>({ "abc" }));
+
+    // more characters
+    ASSERT_TRUE(test_lib_split_strings("a::b:c::::d::", "::", SPLIT_KEEP_EMPTY) == vector<string>({ "a", "b:c", "", "d", "" }));
+    ASSERT_TRUE(test_lib_split_strings("a\r\nb\r\n", "\r\n", SPLIT_DROP_TRAILING) == vector<string>({ "a", "b" }));
+    ASSERT_TRUE(test_lib_split_strings("a:", "::", SPLIT_KEEP_EMPTY) == vector<string>({ "a:" }));
+
+    // views into the string, the vector is reused
+    string line = "key=value;other=more";
+    vector<string_view> tokens = { "old" };
+    ASSERT_EQUALS(2, split(line, ";", tokens));
+    ASSERT_TRUE(tokens[1].data() == line.data() + 10);
+    ASSERT_STRING_EQUALS("other=more", string(tokens[1]));
+    ASSERT_EQUALS(0, split("", ";", tokens, SPLIT_SKIP_EMPTY));
+}
+
+TEST_CASE(test_lib_split, test_lib_split_vs_getline) {
+    // long lines go through the SIMD blocks, the delimiters at any offset
+    RANDOM_SEED(21);
+    for (int i = 0; i < 500; i++) {
+        string str(RAND(0, 200), 'x');
+        for (char& c: str) if (!RAND(0, 5)) c = RAND(0, 1) ? ',' : '\n';
+        ASSERT_TRUE(test_lib_split_getline(',', str) == explode(',', str));
+        ASSERT_TRUE(test_lib_split_getline('\n', str) == explode('\n', str));
+        const char* found = split_find(str.data(), str.data() + str.size(), ',');
+        ASSERT_EQUALS(str.find(',') == string::npos ? str.size() : str.find(','), found - str.data());
+        found = split_find(str.data(), str.data() + str.size(), string_view(",\n"));
+        ASSERT_EQUALS(str.find(",\n") == string::npos ? str.size() : str.find(",\n"), found - str.data());
+    }
+}
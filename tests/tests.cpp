@@ -2,14 +2,26 @@
 
 #include "Test.h"
 #include "lib/test_lib.h"
-// NOTE: include more tests here...
+#include "lib/test_Timer.h"
+#include "lib/test_TimerWheel.h"
+#include "lib/test_EventLoop.h"
+#include "lib/test_VirtualClock.h"
+#include "lib/test_datef.h"
+#include "lib/test_TimeZone.h"
+#include "lib/test_Regex.h"
+#include "lib/test_split.h"
+#include "lib/test_format.h"
+#include "lib/test_Logger.h"
+#include "lib/test_Process.h"
+#include "lib/bench_lib.h"
+// NOTE: include more tests here, the TEST_CASE()s register themselves...
 
 using namespace std;
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
-	TEST(test_lib);
-        // TODO: call more tests here...
+        TestRunner runner(argc, argv);
+        if (runner.run()) return -1;
     } 
     // LCOV_EXCL_START
     catch (exception &e) {
@@ -17,4 +29,4 @@ int main() {
         return -1;
     }
     // LCOV_EXCL_STOP
-}
\ No newline at end of file
+}